@@ -14,9 +14,30 @@ https://github.com/lidaohang/ceph_study/blob/master/LRU-K%E5%92%8C2Q%E7%BC%93%E5
 */
 
 #include <iostream>
+#include <fstream>
 #include <unordered_map>
-#include <queue>
+#include <cstdint>
 #include <list>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <tuple>
+#include <type_traits>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <thread>
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+#if defined(__cpp_impl_coroutine) && __cplusplus >= 202002L
+#include <coroutine>
+#include <optional>
+#endif
 #include <chrono> //用于steady_clock::time_point
 #include <assert.h>
 
@@ -37,272 +58,5423 @@ std::string to_string_if_not_string(const T& value, typename std::enable_if<std:
     return value;  // 字符串类型，直接返回
 }
 
-template <typename KEY, typename VALUE>
+// 定长环形缓冲区，保存最近N次访问时间，满了之后再写入会覆盖最早的记录。
+// N在编译期确定时数据直接内嵌在对象中，不需要任何堆分配，ALLOC不会被使用。
+template <typename T, size_t N, typename ALLOC = allocator<T> >
+class RingBuffer
+{
+    T data_[N];
+    uint32_t head_;  // 最早一条记录的下标
+    uint32_t size_;
+
+public:
+    explicit RingBuffer(size_t capacity = N, const ALLOC & = ALLOC()) : head_(0), size_(0) { assert(capacity <= N); }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return N; }
+    bool empty() const { return size_ == 0; }
+    bool full() const { return size_ == N; }
+    const T &front() const { return data_[head_]; }
+    const T &back() const { return data_[head_ + size_ - 1 < N ? head_ + size_ - 1 : head_ + size_ - 1 - N]; }
+
+    void push(const T &t)
+    {
+        if (size_ < N)
+        {
+            uint32_t tail = head_ + size_;
+            data_[tail < N ? tail : tail - N] = t;
+            size_++;
+            return;
+        }
+        data_[head_] = t;
+        head_ = head_ + 1 < N ? head_ + 1 : 0;
+    }
+};
+
+// N为0时容量在运行期确定，容量不超过INLINE_CAPACITY时使用内嵌存储，超过时才通过ALLOC分配。
+// 继承ALLOC，无状态的分配器不占空间
+template <typename T, typename ALLOC>
+class RingBuffer<T, 0, ALLOC> : private ALLOC
+{
+    static const uint32_t INLINE_CAPACITY = 4;
+
+    T inline_[INLINE_CAPACITY];
+    T *data_;
+    uint32_t capacity_;
+    uint32_t head_;
+    uint32_t size_;
+
+    uint32_t index(uint32_t i) const { return head_ + i < capacity_ ? head_ + i : head_ + i - capacity_; }
+
+    T *allocate(uint32_t capacity)
+    {
+        if (capacity <= INLINE_CAPACITY)
+            return inline_;
+        T *data = allocator_traits<ALLOC>::allocate(*this, capacity);
+        for (uint32_t i = 0; i < capacity; i++)
+            allocator_traits<ALLOC>::construct(*this, data + i);
+        return data;
+    }
+
+    void assign(const RingBuffer &other)
+    {
+        capacity_ = other.capacity_;
+        data_ = allocate(capacity_);
+        head_ = 0;
+        size_ = other.size_;
+        for (uint32_t i = 0; i < size_; i++)
+            data_[i] = other.data_[other.index(i)];
+    }
+
+    void release()
+    {
+        if (data_ != inline_)
+        {
+            for (uint32_t i = 0; i < capacity_; i++)
+                allocator_traits<ALLOC>::destroy(*this, data_ + i);
+            allocator_traits<ALLOC>::deallocate(*this, data_, capacity_);
+        }
+        data_ = inline_;
+    }
+
+public:
+    explicit RingBuffer(size_t capacity, const ALLOC &alloc = ALLOC())
+        : ALLOC(alloc), capacity_(capacity > 0 ? static_cast<uint32_t>(capacity) : 1), head_(0), size_(0)
+    {
+        data_ = allocate(capacity_);
+    }
+
+    RingBuffer(const RingBuffer &other) : ALLOC(other) { assign(other); }
+
+    // 堆上的数据直接接管，Slab扩容移动记录时不需要重新分配
+    RingBuffer(RingBuffer &&other)
+        : ALLOC(other), capacity_(other.capacity_), head_(other.head_), size_(other.size_)
+    {
+        if (other.data_ == other.inline_)
+        {
+            data_ = inline_;
+            for (uint32_t i = 0; i < INLINE_CAPACITY; i++)
+                inline_[i] = other.inline_[i];
+        }
+        else
+        {
+            data_ = other.data_;
+            other.data_ = other.inline_;
+            other.capacity_ = 1;
+            other.head_ = other.size_ = 0;
+        }
+    }
+
+    RingBuffer &operator=(const RingBuffer &other)
+    {
+        if (this != &other)
+        {
+            release();
+            assign(other);
+        }
+        return *this;
+    }
+
+    ~RingBuffer() { release(); }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+    bool full() const { return size_ == capacity_; }
+    const T &front() const { return data_[head_]; }
+    const T &back() const { return data_[index(size_ - 1)]; }
+
+    void push(const T &t)
+    {
+        if (size_ < capacity_)
+        {
+            data_[index(size_)] = t;
+            size_++;
+            return;
+        }
+        data_[head_] = t;
+        head_ = head_ + 1 < capacity_ ? head_ + 1 : 0;
+    }
+};
+
+// 逻辑时钟：每次访问计数器加一，比读取系统时钟开销小，且两次访问的时间不会相同。
+// 保留时长以访问次数计。
+class LogicalClock
+{
+    uint64_t tick_;
+
+public:
+    typedef uint64_t time_point;
+    // 使用单独的类型，避免与构造函数中的int参数混淆
+    struct duration
+    {
+        uint64_t ticks_;
+        explicit duration(uint64_t ticks = 0) : ticks_(ticks) {}
+    };
+
+    LogicalClock() : tick_(0) {}
+
+    time_point now() { return ++tick_; }
+    // 读取当前时间但不计为一次访问
+    time_point current() const { return tick_; }
+    static bool enabled(duration d) { return d.ticks_ > 0; }
+    static time_point expireBefore(time_point now, duration d) { return now > d.ticks_ ? now - d.ticks_ : 0; }
+
+    // 时间轮使用的整数刻度，逻辑时钟的一次访问即一个刻度
+    static uint64_t ticks(time_point t) { return t; }
+    static uint64_t deadline(time_point now, duration ttl) { return now + ttl.ticks_; }
+};
+
+// 系统时钟：需要按真实时间保留历史记录时使用
+class SteadyClock
+{
+public:
+    typedef steady_clock::time_point time_point;
+    typedef steady_clock::duration duration;
+
+    time_point now() const { return steady_clock::now(); }
+    time_point current() const { return steady_clock::now(); }
+    static bool enabled(duration d) { return d > duration::zero(); }
+    static time_point expireBefore(time_point now, duration d) { return now - d; }
+
+    // 时间轮以毫秒为刻度，到期时间向上取整，数据不会提前过期，最多推迟1毫秒
+    static uint64_t ticks(time_point t) { return duration_cast<milliseconds>(t.time_since_epoch()).count(); }
+    static uint64_t deadline(time_point now, duration ttl)
+    {
+        duration d = (now + ttl).time_since_epoch();
+        milliseconds ms = duration_cast<milliseconds>(d);
+        if (ms < d)
+            ms += milliseconds(1);
+        return ms.count();
+    }
+};
+
+// 供多个缓存实例共用的内存池，避免大量实例各自向全局堆申请小块内存造成碎片和malloc竞争。
+// 不超过MAX_POOLED字节的请求按2的幂分级，释放后挂在对应级别的空闲链表上复用，新内存从大块中顺序切分；
+// 更大的请求直接使用operator new。大块内存在arena析构时统一归还，arena必须比使用它的缓存活得更久。
+// 非线程安全，多线程时每个线程或每个分片使用各自的arena
+class CacheArena
+{
+    enum { MIN_SHIFT = 4, MAX_SHIFT = 16, BLOCK_SIZE = 256 * 1024 };
+
+    struct FreeNode
+    {
+        FreeNode *next_;
+    };
+
+    FreeNode *free_[MAX_SHIFT - MIN_SHIFT + 1];  // 每个级别的空闲链表
+    vector<char *> blocks_;
+    char *cur_;  // 当前大块中未切分部分的起止
+    char *end_;
+
+    CacheArena(const CacheArena &);
+    CacheArena &operator=(const CacheArena &);
+
+    static size_t sizeClass(size_t n)
+    {
+        size_t c = 0;
+        while ((static_cast<size_t>(1) << (c + MIN_SHIFT)) < n)
+            c++;
+        return c;
+    }
+
+public:
+    static const size_t MAX_POOLED = static_cast<size_t>(1) << MAX_SHIFT;
+
+    CacheArena() : cur_(NULL), end_(NULL) { fill(free_, free_ + MAX_SHIFT - MIN_SHIFT + 1, static_cast<FreeNode *>(NULL)); }
+
+    ~CacheArena()
+    {
+        for (size_t i = 0; i < blocks_.size(); i++)
+            ::operator delete(blocks_[i]);
+    }
+
+    // 返回的内存按16字节对齐
+    void *allocate(size_t n)
+    {
+        if (n > MAX_POOLED)
+            return ::operator new(n);
+        size_t c = sizeClass(n);
+        if (free_[c] != NULL)
+        {
+            FreeNode *node = free_[c];
+            free_[c] = node->next_;
+            return node;
+        }
+        size_t size = static_cast<size_t>(1) << (c + MIN_SHIFT);
+        if (static_cast<size_t>(end_ - cur_) < size)
+        {
+            blocks_.push_back(static_cast<char *>(::operator new(BLOCK_SIZE)));
+            cur_ = blocks_.back();
+            end_ = cur_ + BLOCK_SIZE;
+        }
+        void *p = cur_;
+        cur_ += size;
+        return p;
+    }
+
+    void deallocate(void *p, size_t n)
+    {
+        if (n > MAX_POOLED)
+        {
+            ::operator delete(p);
+            return;
+        }
+        size_t c = sizeClass(n);
+        FreeNode *node = static_cast<FreeNode *>(p);
+        node->next_ = free_[c];
+        free_[c] = node;
+    }
+};
+
+// 从CacheArena分配内存的标准分配器，可作为LRUK_Cache的ALLOC参数
+template <typename T>
+class ArenaAllocator
+{
+    static_assert(alignof(T) <= 16, "CacheArena only guarantees 16-byte alignment");
+
+public:
+    typedef T value_type;
+
+    CacheArena *arena_;
+
+    ArenaAllocator(CacheArena *arena) : arena_(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena_) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(arena_->allocate(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { arena_->deallocate(p, n * sizeof(T)); }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena_ == b.arena_; }
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena_ != b.arena_; }
+
+// Slab和IntrusiveList中表示空下标
+const uint32_t NIL_INDEX = 0xFFFFFFFFu;
+
+// 对象池：对象连续存放在预先分配的数组中，通过32位下标访问，释放的槽位由空闲栈复用。
+// 容量足够时allocate/free不会分配内存；容量不足时扩容为两倍，对象移动到新数组，下标保持不变
+template <typename T, typename ALLOC = allocator<T> >
+class Slab
+{
+    typedef typename aligned_storage<sizeof(T), alignof(T)>::type Storage;
+    typedef typename allocator_traits<ALLOC>::template rebind_alloc<Storage> StorageAllocator;
+
+    StorageAllocator alloc_;
+    Storage *data_;
+    vector<bool, typename allocator_traits<ALLOC>::template rebind_alloc<bool> > live_;          // 槽位上是否有对象
+    vector<uint32_t, typename allocator_traits<ALLOC>::template rebind_alloc<uint32_t> > free_;  // 空闲槽位，栈顶为下标最小的槽位
+    size_t size_;
+
+    Slab(const Slab &);
+    Slab &operator=(const Slab &);
+
+    T *ptr(uint32_t i) const { return reinterpret_cast<T *>(&data_[i]); }
+
+public:
+    explicit Slab(const ALLOC &alloc = ALLOC())
+        : alloc_(alloc), data_(NULL), live_(alloc_), free_(alloc_), size_(0) {}
+
+    ~Slab()
+    {
+        clear();
+        if (data_ != NULL)
+            allocator_traits<StorageAllocator>::deallocate(alloc_, data_, live_.size());
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return live_.size(); }
+
+    T &operator[](uint32_t i) { return *ptr(i); }
+    const T &operator[](uint32_t i) const { return *ptr(i); }
+
+    void reserve(size_t capacity)
+    {
+        size_t old_capacity = live_.size();
+        if (capacity <= old_capacity)
+            return;
+        assert(capacity <= NIL_INDEX);
+        Storage *data = allocator_traits<StorageAllocator>::allocate(alloc_, capacity);
+        for (size_t i = 0; i < old_capacity; i++)
+        {
+            if (!live_[i])
+                continue;
+            new (&data[i]) T(std::move(*ptr(i)));
+            ptr(i)->~T();
+        }
+        if (data_ != NULL)
+            allocator_traits<StorageAllocator>::deallocate(alloc_, data_, old_capacity);
+        data_ = data;
+        live_.resize(capacity, false);
+        vector<uint32_t, typename allocator_traits<ALLOC>::template rebind_alloc<uint32_t> > free_slots(free_.get_allocator());
+        free_slots.reserve(capacity);
+        for (size_t i = capacity; i > old_capacity; i--)
+            free_slots.push_back(static_cast<uint32_t>(i - 1));
+        free_slots.insert(free_slots.end(), free_.begin(), free_.end());
+        free_.swap(free_slots);
+    }
+
+    // 在空闲槽位上以args构造对象，返回其下标
+    template <typename... Args>
+    uint32_t allocate(Args&&... args)
+    {
+        if (free_.empty())
+            reserve(live_.size() < 8 ? 16 : live_.size() * 2);
+        uint32_t i = free_.back();
+        new (&data_[i]) T(std::forward<Args>(args)...);
+        free_.pop_back();
+        live_[i] = true;
+        size_++;
+        return i;
+    }
+
+    void free(uint32_t i)
+    {
+        ptr(i)->~T();
+        live_[i] = false;
+        free_.push_back(i);
+        size_--;
+    }
+
+    // 析构所有对象，保留已分配的数组
+    void clear()
+    {
+        free_.clear();
+        for (size_t i = live_.size(); i > 0; i--)
+        {
+            if (live_[i - 1])
+            {
+                ptr(i - 1)->~T();
+                live_[i - 1] = false;
+            }
+            free_.push_back(static_cast<uint32_t>(i - 1));
+        }
+        size_ = 0;
+    }
+};
+
+// 侵入式双向链表：节点是Slab中的对象，通过对象的prev_/next_下标相连，链表本身不分配内存。
+// 节点在链表之间移动只修改下标，Slab中的位置不变
+template <typename T, typename ALLOC = allocator<T> >
+class IntrusiveList
+{
+    uint32_t head_, tail_;
+    size_t size_;
+
+public:
+    IntrusiveList() : head_(NIL_INDEX), tail_(NIL_INDEX), size_(0) {}
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    uint32_t front() const { return head_; }
+    uint32_t back() const { return tail_; }
+
+    void push_front(Slab<T, ALLOC> &slab, uint32_t i)
+    {
+        T &node = slab[i];
+        node.prev_ = NIL_INDEX;
+        node.next_ = head_;
+        if (head_ != NIL_INDEX)
+            slab[head_].prev_ = i;
+        else
+            tail_ = i;
+        head_ = i;
+        size_++;
+    }
+
+    // 将节点从链表中摘下，不释放节点
+    void erase(Slab<T, ALLOC> &slab, uint32_t i)
+    {
+        T &node = slab[i];
+        if (node.prev_ != NIL_INDEX)
+            slab[node.prev_].next_ = node.next_;
+        else
+            head_ = node.next_;
+        if (node.next_ != NIL_INDEX)
+            slab[node.next_].prev_ = node.prev_;
+        else
+            tail_ = node.prev_;
+        node.prev_ = node.next_ = NIL_INDEX;
+        size_--;
+    }
+
+    void move_to_front(Slab<T, ALLOC> &slab, uint32_t i)
+    {
+        if (head_ == i)
+            return;
+        erase(slab, i);
+        push_front(slab, i);
+    }
+
+    void clear()
+    {
+        head_ = tail_ = NIL_INDEX;
+        size_ = 0;
+    }
+};
+
+// 没有到期时间
+const uint64_t NEVER_EXPIRE = ~static_cast<uint64_t>(0);
+// 节点不在时间轮中
+const uint16_t NO_TIMER_SLOT = 0xFFFF;
+
+// 分层时间轮：每层SLOTS个槽位，第l层的一个槽位跨SLOTS^l个刻度，节点按到期刻度离当前的距离放在能容纳它的最低层。
+// 节点是Slab中的对象，通过expire_tick_、timer_prev_/timer_next_和timer_slot_挂在槽位上，时间轮本身不分配内存。
+// 加入和取消O(1)；推进时只处理经过的槽位，下层为空时直接跳到上层槽位的边界。上层槽位到期时其中的节点
+// 按剩余时间放回下层，每个节点最多下移LEVELS-1次，因此到期处理均摊O(1)
+template <typename T, typename ALLOC = allocator<T> >
+class TimerWheel
+{
+    enum { SLOT_BITS = 6, SLOTS = 1 << SLOT_BITS, LEVELS = 6 };
+
+    uint32_t heads_[LEVELS * SLOTS];
+    size_t level_size_[LEVELS];
+    size_t size_;
+    uint64_t now_;  // 已处理到的刻度
+
+    static uint64_t span(size_t level) { return static_cast<uint64_t>(1) << (SLOT_BITS * level); }
+
+    void link(Slab<T, ALLOC> &slab, uint32_t i)
+    {
+        T &node = slab[i];
+        uint64_t when = max(node.expire_tick_, now_ + 1);
+        uint64_t delta = when - now_;
+        size_t level = 0;
+        while (level + 1 < LEVELS && delta >= span(level + 1))
+            level++;
+        size_t slot;
+        if (delta >= span(LEVELS))
+        {
+            // 超出最上层的范围，放在最上层最后处理的槽位，处理时重新计算位置
+            slot = ((now_ >> (SLOT_BITS * level)) - 1) & (SLOTS - 1);
+        }
+        else
+            slot = (when >> (SLOT_BITS * level)) & (SLOTS - 1);
+        slot += level * SLOTS;
+        node.timer_slot_ = static_cast<uint16_t>(slot);
+        node.timer_prev_ = NIL_INDEX;
+        node.timer_next_ = heads_[slot];
+        if (heads_[slot] != NIL_INDEX)
+            slab[heads_[slot]].timer_prev_ = i;
+        heads_[slot] = i;
+        level_size_[level]++;
+        size_++;
+    }
+
+    void unlink(Slab<T, ALLOC> &slab, uint32_t i)
+    {
+        T &node = slab[i];
+        if (node.timer_prev_ != NIL_INDEX)
+            slab[node.timer_prev_].timer_next_ = node.timer_next_;
+        else
+            heads_[node.timer_slot_] = node.timer_next_;
+        if (node.timer_next_ != NIL_INDEX)
+            slab[node.timer_next_].timer_prev_ = node.timer_prev_;
+        level_size_[node.timer_slot_ / SLOTS]--;
+        size_--;
+        node.timer_slot_ = NO_TIMER_SLOT;
+        node.timer_prev_ = node.timer_next_ = NIL_INDEX;
+    }
+
+    // 处理一个槽位：到期的节点交给expire，其余按剩余时间放回下层
+    template <typename F>
+    void flush(Slab<T, ALLOC> &slab, size_t slot, F &expire)
+    {
+        uint32_t i = heads_[slot];
+        while (i != NIL_INDEX)
+        {
+            uint32_t next = slab[i].timer_next_;
+            unlink(slab, i);
+            if (slab[i].expire_tick_ <= now_)
+            {
+                slab[i].expire_tick_ = NEVER_EXPIRE;
+                expire(i);
+            }
+            else
+                link(slab, i);
+            i = next;
+        }
+    }
+
+public:
+    TimerWheel() : size_(0), now_(0) { clear(); }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    bool scheduled(const T &node) const { return node.timer_slot_ != NO_TIMER_SLOT; }
+
+    // 设置节点i在deadline刻度到期，已设置过则重新设置。now为当前刻度
+    void schedule(Slab<T, ALLOC> &slab, uint32_t i, uint64_t deadline, uint64_t now)
+    {
+        if (scheduled(slab[i]))
+            unlink(slab, i);
+        else if (size_ == 0 && now_ < now)
+            now_ = now;
+        slab[i].expire_tick_ = deadline;
+        link(slab, i);
+    }
+
+    void cancel(Slab<T, ALLOC> &slab, uint32_t i)
+    {
+        if (!scheduled(slab[i]))
+            return;
+        unlink(slab, i);
+        slab[i].expire_tick_ = NEVER_EXPIRE;
+    }
+
+    // 推进到now刻度，对每个到期的节点调用expire(i)，调用前节点已从时间轮摘下，expire可以释放节点
+    template <typename F>
+    void advance(Slab<T, ALLOC> &slab, uint64_t now, F &expire)
+    {
+        while (now_ < now && size_ > 0)
+        {
+            size_t level = 0;
+            while (level_size_[level] == 0)
+                level++;
+            // 低于level的层都为空，下一个需要处理的刻度是level层下一个槽位的边界
+            uint64_t next = ((now_ >> (SLOT_BITS * level)) + 1) << (SLOT_BITS * level);
+            if (next > now)
+                break;
+            now_ = next;
+            // 先处理上层，放回下层的节点可能正好落在本刻度要处理的槽位中
+            for (size_t l = LEVELS - 1; l > 0; l--)
+            {
+                if ((now_ & (span(l) - 1)) == 0)
+                    flush(slab, l * SLOTS + ((now_ >> (SLOT_BITS * l)) & (SLOTS - 1)), expire);
+            }
+            flush(slab, now_ & (SLOTS - 1), expire);
+        }
+        if (now_ < now)
+            now_ = now;
+    }
+
+    // 清空所有槽位，不修改节点
+    void clear()
+    {
+        fill(heads_, heads_ + LEVELS * SLOTS, NIL_INDEX);
+        fill(level_size_, level_size_ + LEVELS, static_cast<size_t>(0));
+        size_ = 0;
+    }
+};
+
+// K为0表示访问次数在运行期确定，K较大时访问时间通过ALLOC分配
+template <typename KEY, typename VALUE, size_t K = 0, typename CLOCK = LogicalClock, typename ALLOC = allocator<char> >
 class CacheEntry
 {
 public:
-    KEY key_;
-    VALUE value_;
-    queue<steady_clock::time_point> access_time_; // 最近K次访问时间记录,时间早的优先被淘汰
+    KEY key_;
+    VALUE value_;
+    RingBuffer<typename CLOCK::time_point, K, typename allocator_traits<ALLOC>::template rebind_alloc<typename CLOCK::time_point> > access_time_; // 最近K次访问时间记录,时间早的优先被淘汰
+    uint32_t heap_index_;                                   // 在cacheList_最小堆中的下标，不在cacheList_中时为npos
+    uint32_t prev_, next_;                                  // 所在IntrusiveList中前后节点在Slab中的下标
+    uint64_t expire_tick_;                                  // 到期的时钟刻度，没有设置存活时间时为NEVER_EXPIRE
+    uint32_t timer_prev_, timer_next_;                      // 所在时间轮槽位中前后节点的下标
+    uint16_t timer_slot_;                                   // 所在时间轮槽位
+    uint32_t pins_;                                         // 被固定的次数，大于0时不会被淘汰、降级或过期删除
+
+    static const uint32_t npos = NIL_INDEX;
+    static const uint32_t pinned_in_cache = NIL_INDEX - 1;  // 在cacheList_中但被固定，暂时不在堆中
+
+    // 值由args原地构造
+    template <typename... Args>
+    CacheEntry(const KEY &k, size_t history_size, const ALLOC &alloc, Args&&... args)
+        : key_(k), value_(std::forward<Args>(args)...), access_time_(history_size, alloc), heap_index_(npos),
+          prev_(NIL_INDEX), next_(NIL_INDEX), expire_tick_(NEVER_EXPIRE), timer_prev_(NIL_INDEX), timer_next_(NIL_INDEX),
+          timer_slot_(NO_TIMER_SLOT), pins_(0) {}
+
+    bool inCache() const { return heap_index_ != npos; }
+};
+
+//cachelist排序比较函数，时间从新到旧的顺序排序
+template <typename ENTRY>
+bool compareByAccessTime(const ENTRY& a, const ENTRY& b) {
+    return a.access_time_.front() > b.access_time_.front();  // 最新的时间排在前面
+}
+
+template <typename ITER>
+bool compareIterByAccessTime(const ITER& a, const ITER& b) {
+    return compareByAccessTime(*a, *b);
+}
+
+// 预取p所在的缓存行，批量操作中提前发出后续key的内存访问
+inline void prefetchAddress(const void *p)
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(p);
+#else
+    (void)p;
+#endif
+}
+
+// 开放寻址（线性探测）的hash索引，数据连续存放，查找时不需要追逐链表节点。
+// 每个槽位对应一个控制字节：空、已删除，或key的hash高7位，探测时先比较控制字节，
+// 相同时才通过KEYOF从MAPPED中取出key做完整比较，因此槽位中不需要保存key的副本。
+// 没有按组(SIMD)比较控制字节，也没有Robin Hood重排：负载不超过7/8时大多数key就在探测链起点，
+// 逐字节探测时槽位地址不依赖控制字节的读取结果，两次内存访问可以重叠；
+// 按8字节一组比较时命中反而更慢，只有未命中更快
+template <typename KEY, typename MAPPED, typename KEYOF, typename HASH = hash<KEY>, typename ALLOC = allocator<MAPPED> >
+class FlatIndex
+{
+    enum { EMPTY = 0x80, DELETED = 0xFE };
+
+    vector<uint8_t, typename allocator_traits<ALLOC>::template rebind_alloc<uint8_t> > ctrl_;
+    vector<MAPPED, typename allocator_traits<ALLOC>::template rebind_alloc<MAPPED> > slots_;
+    vector<uint8_t, typename allocator_traits<ALLOC>::template rebind_alloc<uint8_t> > old_ctrl_;   // rehash时存放旧数组
+    vector<MAPPED, typename allocator_traits<ALLOC>::template rebind_alloc<MAPPED> > old_slots_;
+    size_t size_;  // 有效元素个数
+    size_t used_;  // 有效元素与已删除槽位个数之和，决定何时rehash
+    size_t mask_;
+    HASH hasher_;
+    KEYOF key_of_;
+
+    // 对用户提供的hash再做一次混合，std::hash<int>之类的恒等hash也能均匀分布
+    size_t mix(const KEY &k) const
+    {
+        uint64_t h = static_cast<uint64_t>(hasher_(k));
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        return static_cast<size_t>(h);
+    }
+
+    static uint8_t tag(size_t h) { return static_cast<uint8_t>(h >> (sizeof(size_t) * 8 - 7)); }
+
+    // 原容量重建（清理已删除槽位）时复用上次的旧数组，稳定状态下不再分配内存
+    void rehash(size_t capacity)
+    {
+        if (capacity == ctrl_.size())
+        {
+            old_ctrl_.swap(ctrl_);
+            old_slots_.swap(slots_);
+            ctrl_.assign(capacity, EMPTY);
+            slots_.resize(capacity);
+        }
+        else
+        {
+            vector<uint8_t, typename allocator_traits<ALLOC>::template rebind_alloc<uint8_t> > ctrl(capacity, EMPTY, ctrl_.get_allocator());
+            vector<MAPPED, typename allocator_traits<ALLOC>::template rebind_alloc<MAPPED> > slots(capacity, MAPPED(), slots_.get_allocator());
+            ctrl.swap(ctrl_);
+            slots.swap(slots_);
+            old_ctrl_.swap(ctrl);
+            old_slots_.swap(slots);
+        }
+        mask_ = capacity - 1;
+        used_ = size_;
+        for (size_t i = 0; i < old_ctrl_.size(); i++)
+        {
+            if (old_ctrl_[i] & EMPTY)
+                continue;
+            size_t h = mix(key_of_(old_slots_[i]));
+            size_t pos = h & mask_;
+            while (ctrl_[pos] != EMPTY)
+                pos = (pos + 1) & mask_;
+            ctrl_[pos] = tag(h);
+            slots_[pos] = old_slots_[i];
+        }
+        // 扩容后旧数组比新数组小，不能用于之后的原容量重建
+        if (old_ctrl_.size() != capacity)
+        {
+            vector<uint8_t, typename allocator_traits<ALLOC>::template rebind_alloc<uint8_t> >(ctrl_.get_allocator()).swap(old_ctrl_);
+            vector<MAPPED, typename allocator_traits<ALLOC>::template rebind_alloc<MAPPED> >(slots_.get_allocator()).swap(old_slots_);
+        }
+    }
+
+    size_t findSlot(const KEY &k, size_t h) const
+    {
+        uint8_t t = tag(h);
+        for (size_t pos = h & mask_;; pos = (pos + 1) & mask_)
+        {
+            uint8_t c = ctrl_[pos];
+            if (c == EMPTY)
+                return npos;
+            if (c == t && key_of_(slots_[pos]) == k)
+                return pos;
+        }
+    }
+
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    explicit FlatIndex(const KEYOF &key_of = KEYOF(), const ALLOC &alloc = ALLOC())
+        : ctrl_(16, EMPTY, alloc), slots_(16, MAPPED(), alloc), old_ctrl_(alloc), old_slots_(alloc),
+          size_(0), used_(0), mask_(15), key_of_(key_of) {}
+
+    size_t size() const { return size_; }
+
+    // 预留n个元素的空间：容量大于n的两倍，元素不超过n个时reserveOne只会原容量重建，不会扩容
+    void reserve(size_t n)
+    {
+        size_t capacity = ctrl_.size();
+        while (n * 2 >= capacity)
+            capacity *= 2;
+        if (capacity != ctrl_.size())
+            rehash(capacity);
+    }
+
+    // 计算k的hash，同一次操作中的查找和插入共用，避免重复计算
+    size_t hashOf(const KEY &k) const { return mix(k); }
+
+    // 返回k对应的值，不存在时返回NULL
+    MAPPED *find(const KEY &k) { return find(k, mix(k)); }
+
+    MAPPED *find(const KEY &k, size_t h)
+    {
+        size_t pos = findSlot(k, h);
+        return pos == npos ? NULL : &slots_[pos];
+    }
+
+    const MAPPED *find(const KEY &k, size_t h) const
+    {
+        size_t pos = findSlot(k, h);
+        return pos == npos ? NULL : &slots_[pos];
+    }
+
+    // 保证接下来的一次插入不会触发rehash，使probe返回的槽位在insertAt时仍然有效。
+    // 负载（含已删除槽位）不超过7/8；已删除的槽位多时原容量重建即可
+    void reserveOne()
+    {
+        if ((used_ + 1) * 8 > ctrl_.size() * 7)
+            rehash(size_ * 2 >= ctrl_.size() ? ctrl_.size() * 2 : ctrl_.size());
+    }
+
+    // 一次探测同时完成查找和插入定位：找到k时found为true，返回k所在槽位；
+    // 否则返回探测路径上第一个可插入的槽位，之后可直接insertAt。
+    // probe之后insertAt之前不能修改索引，否则需要重新probe。
+    size_t probe(const KEY &k, size_t h, bool &found)
+    {
+        uint8_t t = tag(h);
+        size_t insert_pos = npos;
+        for (size_t pos = h & mask_;; pos = (pos + 1) & mask_)
+        {
+            uint8_t c = ctrl_[pos];
+            if (c == t && key_of_(slots_[pos]) == k)
+            {
+                found = true;
+                return pos;
+            }
+            if ((c & EMPTY) && insert_pos == npos)
+                insert_pos = pos;
+            if (c == EMPTY)
+            {
+                found = false;
+                return insert_pos;
+            }
+        }
+    }
+
+    MAPPED &at(size_t pos) { return slots_[pos]; }
+
+    // 预取hash为h的key所在探测链起点的控制字节和槽位
+    void prefetch(size_t h) const
+    {
+        prefetchAddress(&ctrl_[h & mask_]);
+        prefetchAddress(&slots_[h & mask_]);
+    }
+
+    // 返回探测链上第一个控制字节与h匹配的槽位，不比较key，结果可能不是要找的key，只用于预取
+    const MAPPED *hint(size_t h) const
+    {
+        uint8_t t = tag(h);
+        for (size_t pos = h & mask_;; pos = (pos + 1) & mask_)
+        {
+            uint8_t c = ctrl_[pos];
+            if (c == EMPTY)
+                return NULL;
+            if (c == t)
+                return &slots_[pos];
+        }
+    }
+
+    void insertAt(size_t pos, size_t h, const MAPPED &m)
+    {
+        if (ctrl_[pos] == EMPTY)
+            used_++;
+        ctrl_[pos] = tag(h);
+        slots_[pos] = m;
+        size_++;
+    }
+
+    // 插入k，调用方需保证k不存在
+    void insert(const KEY &k, const MAPPED &m)
+    {
+        reserveOne();
+        size_t h = mix(k);
+        bool found;
+        insertAt(probe(k, h, found), h, m);
+    }
+
+    bool erase(const KEY &k)
+    {
+        size_t pos = findSlot(k, mix(k));
+        if (pos == npos)
+            return false;
+        // 下一个槽位为空时没有探测链经过这里，可以直接置空，不必留下删除标记
+        if (ctrl_[(pos + 1) & mask_] == EMPTY)
+        {
+            ctrl_[pos] = EMPTY;
+            used_--;
+        }
+        else
+            ctrl_[pos] = DELETED;
+        slots_[pos] = MAPPED();
+        size_--;
+        return true;
+    }
+
+    // 清空元素，保留当前容量
+    void clear()
+    {
+        ctrl_.assign(ctrl_.size(), EMPTY);
+        slots_.assign(slots_.size(), MAPPED());
+        size_ = used_ = 0;
+    }
+};
+
+// 值离开缓存的原因
+enum class RemovalCause
+{
+    EVICTED,  // 超出容量或权重上限，从historyList_或ghost暂存区丢弃
+    EXPIRED,  // 存活时间到期，或历史记录超过保留时长
+    DEMOTED   // 从cacheList_淘汰回historyList_，值仍保留在缓存中
+};
+
+// K为0时访问次数由构造函数参数在运行期指定；
+// K大于0时在编译期确定，K=1退化为普通LRU（cacheList_按最近访问排序，不需要堆），K=2时每条记录只内嵌两个时间戳
+// CLOCK为访问时间的来源，默认使用LogicalClock，需要按真实时间保留历史记录时使用SteadyClock
+// ALLOC用于记录、索引、堆、访问时间和暂存区的内存，可使用ArenaAllocator让多个实例共用一个CacheArena，
+// C++17下也可以使用std::pmr::polymorphic_allocator<char>
+template <typename KEY, typename VALUE, size_t K = 0, typename CLOCK = LogicalClock, typename ALLOC = allocator<char> >
+class LRUK_Cache
+{
+    int capacity_;                                                           // 最大可缓存上限
+    int k_;                                                                  // 超过K次之后可移入cacheList
+    int history_capacity_;                                                   // historyList_最多保存的记录数
+    CLOCK clock_;                                                            // 访问时间来源，每次get/put只读取一次
+    typename CLOCK::duration retained_period_;                               // 历史记录保留时长，超过后丢弃，为0表示不限制
+    int target_capacity_;                                                    // setCapacity设置的容量，缩容完成前capacity_大于此值
+    int target_history_capacity_;                                            // setHistoryCapacity设置的容量，含义同上
+    ALLOC alloc_;                                                            // 所有内部容器共用的分配器
+    Slab<CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>, ALLOC> slab_;              // 所有记录的存储，按capacity_+history_capacity_预先分配
+    IntrusiveList<CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>, ALLOC> historyList_;  // 保存历史记录，超过K次访问后移入cacheList。
+    IntrusiveList<CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>, ALLOC> cacheList_;    // 保存热数据记录，查找时优先查找。
+    // 从slab_下标中取出key，供index_比较使用
+    struct EntryKey
+    {
+        const Slab<CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>, ALLOC> *slab_;
+
+        explicit EntryKey(const Slab<CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>, ALLOC> *slab = NULL) : slab_(slab) {}
+        const KEY &operator()(uint32_t i) const { return (*slab_)[i].key_; }
+    };
+    FlatIndex<KEY, uint32_t, EntryKey, hash<KEY>, ALLOC> index_;             // 同时定位historyList_和cacheList_，节点在哪个list由inCache()区分
+    vector<uint32_t, typename allocator_traits<ALLOC>::template rebind_alloc<uint32_t> > cacheHeap_;  // cacheList_的索引最小堆，按倒数第K次访问时间排序
+    bool ghost_history_;                                                     // historyList_只保存key和访问时间，不保存值
+    int staging_capacity_;                                                   // ghost模式下暂存区可保存的值的个数
+    typedef list<pair<KEY, VALUE>, typename allocator_traits<ALLOC>::template rebind_alloc<pair<KEY, VALUE> > > StagingList;
+    typedef unordered_map<KEY, typename StagingList::iterator, hash<KEY>, equal_to<KEY>,
+                          typename allocator_traits<ALLOC>::template rebind_alloc<pair<const KEY, typename StagingList::iterator> > > StagingMap;
+    StagingList stagingList_;                                                // ghost模式下未晋升数据的值，按LRU淘汰
+    StagingMap staging_map_;                                                 // 用于快速定位stagingList_
+    function<void(const KEY &)> on_remove_;                                  // key被彻底移出缓存（从historyList_丢弃）时回调
+    function<void(const KEY &, VALUE &&, RemovalCause)> listener_;           // 值离开缓存时的监听者
+    bool notify_demotion_;                                                   // 是否通知DEMOTED，需要拷贝值
+    function<size_t(const KEY &, const VALUE &)> weigher_;                   // 计算一条记录的权重（如字节数），未设置时每条记录权重为1
+    size_t max_weight_;                                                      // cacheList_的总权重上限，为0表示只按条数限制
+    size_t max_history_weight_;                                              // historyList_的总权重上限，为0表示只按条数限制
+    size_t cache_weight_;                                                    // cacheList_当前总权重
+    size_t history_weight_;                                                  // historyList_当前总权重
+    size_t pinned_;                                                          // 被固定(pins_大于0)的记录数
+    TimerWheel<CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>, ALLOC> timers_;      // 设置了存活时间的记录按到期时间排列
+    typename CLOCK::duration default_ttl_;                                   // 写入时默认的存活时间，为0表示不过期
+
+    // 批量操作每组的key个数：组内先计算hash并预取，再依次访问。
+    // 堆小于DEFER_SIFT_MIN时整体在CPU缓存中，立即调整比推迟后排序处理更快。
+    // 缩容时每次操作最多淘汰RESIZE_STEP条数据
+    enum { BATCH_SIZE = 64, DEFER_SIFT_MIN = 65536, RESIZE_STEP = 32 };
+
+    // 批量get中推迟的堆调整，每项高32位为记录在堆中的位置，低32位为记录的下标。
+    // 推迟期间堆不会被修改，记下的位置在统一处理前一直有效
+    struct DeferredSift
+    {
+        uint64_t entries_[BATCH_SIZE];
+        size_t size_;
+
+        DeferredSift() : size_(0) {}
+    };
+
+    // 记录、索引和堆都在构造时按容量分配好，稳定运行时不再分配内存
+    LRUK_Cache(const LRUK_Cache &);
+    LRUK_Cache &operator=(const LRUK_Cache &);
+
+    void init()
+    {
+        assert(K == 0 || k_ == K);
+        // 历史记录满时先淘汰再插入，cacheList_满时被淘汰的数据先回到历史记录再修剪，最多多出一条
+        size_t entries = static_cast<size_t>(max(capacity_, 0)) + static_cast<size_t>(max(history_capacity_, 0)) + 1;
+        slab_.reserve(entries);
+        index_.reserve(entries);
+        cacheHeap_.reserve(static_cast<size_t>(max(capacity_, 0)));
+    }
+
+    size_t getK() const { return K > 0 ? K : k_; }
+
+    // K=1时倒数第K次访问就是最近一次访问，cacheList_直接按访问先后排列即可，不需要堆
+    bool lruOrdered() const { return getK() == 1; }
+
+    // 堆中a是否应排在b之前：倒数第K次访问时间越早越靠近堆顶
+    bool heapBefore(uint32_t a, uint32_t b) const
+    {
+        return slab_[a].access_time_.front() < slab_[b].access_time_.front();
+    }
+
+    void heapSet(size_t i, uint32_t e)
+    {
+        cacheHeap_[i] = e;
+        slab_[e].heap_index_ = static_cast<uint32_t>(i);
+    }
+
+    void heapSiftUp(size_t i)
+    {
+        uint32_t e = cacheHeap_[i];
+        while (i > 0)
+        {
+            size_t parent = (i - 1) / 2;
+            if (!heapBefore(e, cacheHeap_[parent]))
+                break;
+            heapSet(i, cacheHeap_[parent]);
+            i = parent;
+        }
+        heapSet(i, e);
+    }
+
+    void heapSiftDown(size_t i)
+    {
+        uint32_t e = cacheHeap_[i];
+        size_t n = cacheHeap_.size();
+        while (true)
+        {
+            size_t child = 2 * i + 1;
+            if (child >= n)
+                break;
+            if (child + 1 < n && heapBefore(cacheHeap_[child + 1], cacheHeap_[child]))
+                child++;
+            if (!heapBefore(cacheHeap_[child], e))
+                break;
+            heapSet(i, cacheHeap_[child]);
+            i = child;
+        }
+        heapSet(i, e);
+    }
+
+    // 新元素加入cacheList_后调用，O(log n)。被固定的元素不进入堆，解除固定时再加入
+    void heapPush(uint32_t e)
+    {
+        if (lruOrdered())
+        {
+            slab_[e].heap_index_ = 0;
+            return;
+        }
+        if (slab_[e].pins_ > 0)
+        {
+            slab_[e].heap_index_ = CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>::pinned_in_cache;
+            return;
+        }
+        cacheHeap_.push_back(e);
+        heapSiftUp(cacheHeap_.size() - 1);
+    }
+
+    // 元素从cacheList_移除前调用，O(log n)
+    void heapErase(uint32_t e)
+    {
+        if (lruOrdered() || slab_[e].heap_index_ == CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>::pinned_in_cache)
+        {
+            slab_[e].heap_index_ = CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>::npos;
+            return;
+        }
+        size_t i = slab_[e].heap_index_;
+        uint32_t last = cacheHeap_.back();
+        cacheHeap_.pop_back();
+        slab_[e].heap_index_ = CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>::npos;
+        if (i == cacheHeap_.size())
+            return;
+        heapSet(i, last);
+        heapSiftUp(i);
+        heapSiftDown(slab_[last].heap_index_);
+    }
+
+    // 返回下一个要从cacheList_淘汰的数据，全部被固定时返回NIL_INDEX
+    uint32_t findVictimFromCache()
+    {
+        // 堆顶即为倒数第K次访问离现在最久的数据，被固定的数据不在堆中；
+        // K=1时为cacheList_尾部，跳过被固定的数据
+        if (lruOrdered())
+            return unpinnedFromBack(cacheList_);
+        return cacheHeap_.empty() ? NIL_INDEX : cacheHeap_.front();
+    }
+
+    // 从list尾部开始第一个没有被固定的数据，代价与尾部连续被固定的数据个数成正比
+    uint32_t unpinnedFromBack(const IntrusiveList<CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>, ALLOC> &list) const
+    {
+        uint32_t i = list.back();
+        while (i != NIL_INDEX && slab_[i].pins_ > 0)
+            i = slab_[i].prev_;
+        return i;
+    }
+
+    size_t weigh(uint32_t e) const { return weigher_ ? weigher_(slab_[e].key_, slab_[e].value_) : 1; }
+
+    static bool overWeight(size_t weight, size_t max_weight) { return max_weight > 0 && weight > max_weight; }
+
+    // 记录所在list的总权重，修改记录的值前后分别减去和加上其权重
+    size_t &listWeight(uint32_t e) { return slab_[e].inCache() ? cache_weight_ : history_weight_; }
+
+    // DEMOTED时值仍留在缓存中，只能拷贝给监听者；VALUE不可拷贝时不通知
+    void notifyDemotion(uint32_t e, true_type)
+    {
+        VALUE copy(slab_[e].value_);
+        listener_(slab_[e].key_, std::move(copy), RemovalCause::DEMOTED);
+    }
+
+    void notifyDemotion(uint32_t, false_type) {}
+
+    // 将cacheList_中的e移回historyList_头部，ghost模式下值移入暂存区。
+    // e的最近访问可能早于historyList_中的其他记录，超过保留时长时由retentionExpired在访问时发现
+    void demote(uint32_t e)
+    {
+        // ghost模式下没有暂存区时值不会留在缓存中，由stageValue以EVICTED通知
+        if (notify_demotion_ && listener_ && (!ghost_history_ || staging_capacity_ > 0))
+            notifyDemotion(e, integral_constant<bool, is_copy_constructible<VALUE>::value>());
+        cache_weight_ -= weigh(e);
+        heapErase(e);
+        if (ghost_history_)
+        {
+            stageValue(slab_[e].key_, std::move(slab_[e].value_));
+            slab_[e].value_ = VALUE();
+        }
+        cacheList_.erase(slab_, e);
+        historyList_.push_front(slab_, e);
+        history_weight_ += weigh(e);
+    }
+
+    // cacheList_总权重超出上限时按K距离淘汰keep以外的数据，直到放得下keep；
+    // keep自身超过上限时不淘汰其他数据，直接将keep移回historyList_
+    void shrinkCache(uint32_t keep)
+    {
+        if (!overWeight(cache_weight_, max_weight_) || !slab_[keep].inCache())
+            return;
+        size_t w = weigh(keep);
+        if (w > max_weight_)
+        {
+            if (slab_[keep].pins_ == 0)
+                demote(keep);
+            return;
+        }
+        // keep暂时移出淘汰顺序，重新加入时等同于一次新的晋升。其余数据都被固定时只能暂时超出上限
+        heapErase(keep);
+        cacheList_.erase(slab_, keep);
+        cache_weight_ -= w;
+        while (!cacheList_.empty() && cache_weight_ + w > max_weight_)
+        {
+            uint32_t vict = findVictimFromCache();
+            if (vict == NIL_INDEX)
+                break;
+            demote(vict);
+        }
+        cacheList_.push_front(slab_, keep);
+        heapPush(keep);
+        cache_weight_ += w;
+    }
+
+    // 参数本身就是VALUE时直接赋值（右值则移动），否则先构造再移动赋值
+    template <typename V>
+    static typename enable_if<is_same<typename decay<V>::type, VALUE>::value>::type assignValue(VALUE &dst, V &&v)
+    {
+        dst = std::forward<V>(v);
+    }
+
+    template <typename... Args>
+    static void assignValue(VALUE &dst, Args&&... args) { dst = VALUE(std::forward<Args>(args)...); }
+
+    // ghost模式下暂存k的值(由args构造)，暂存区满时淘汰最久未使用的值。
+    // 暂存区容量为0时值无处保存，直接以EVICTED交给监听者
+    template <typename... Args>
+    void stageValue(const KEY &k, Args&&... args)
+    {
+        typename StagingMap::iterator it = staging_map_.find(k);
+        if (it != staging_map_.end())
+        {
+            assignValue(it->second->second, std::forward<Args>(args)...);
+            stagingList_.splice(stagingList_.begin(), stagingList_, it->second);
+            return;
+        }
+        if (staging_capacity_ <= 0)
+        {
+            if (listener_)
+            {
+                VALUE dropped(std::forward<Args>(args)...);
+                listener_(k, std::move(dropped), RemovalCause::EVICTED);
+            }
+            return;
+        }
+        if (static_cast<int>(stagingList_.size()) >= staging_capacity_)
+        {
+            if (listener_)
+                listener_(stagingList_.back().first, std::move(stagingList_.back().second), RemovalCause::EVICTED);
+            staging_map_.erase(stagingList_.back().first);
+            stagingList_.pop_back();
+        }
+        stagingList_.emplace_front(piecewise_construct, forward_as_tuple(k), forward_as_tuple(std::forward<Args>(args)...));
+        staging_map_.emplace(k, stagingList_.begin());
+    }
+
+    // ghost模式下查找暂存的值，找到则移到暂存区头部
+    VALUE *findStagedValue(const KEY &k)
+    {
+        typename StagingMap::iterator it = staging_map_.find(k);
+        if (it == staging_map_.end())
+            return NULL;
+        stagingList_.splice(stagingList_.begin(), stagingList_, it->second);
+        return &it->second->second;
+    }
+
+    // ghost模式下将暂存的值移出到v中，返回是否找到
+    bool unstageValue(const KEY &k, VALUE &v)
+    {
+        typename StagingMap::iterator it = staging_map_.find(k);
+        if (it == staging_map_.end())
+            return false;
+        v = std::move(it->second->second);
+        stagingList_.erase(it->second);
+        staging_map_.erase(it);
+        return true;
+    }
+
+    void dropStagedValue(const KEY &k)
+    {
+        typename StagingMap::iterator it = staging_map_.find(k);
+        if (it == staging_map_.end())
+            return;
+        stagingList_.erase(it->second);
+        staging_map_.erase(it);
+    }
+
+    // 返回下一个要从historyList_丢弃的数据，全部被固定时返回NIL_INDEX
+    uint32_t findVictimFromHistory()
+    {
+        // historylist按先进先出的原则淘汰数据,最早的数据在尾部
+        return unpinnedFromBack(historyList_);
+    }
+
+    // 将e从所在list、堆和索引中删除并释放，O(log n)；K=1时不需要调整堆，O(1)。
+    // w为e的权重，值可能已被监听者移走时由调用者事先计算
+    void eraseEntry(uint32_t e, size_t w)
+    {
+        if (ghost_history_)
+            dropStagedValue(slab_[e].key_);
+        timers_.cancel(slab_, e);
+        listWeight(e) -= w;
+        if (slab_[e].inCache())
+        {
+            heapErase(e);
+            cacheList_.erase(slab_, e);
+        }
+        else
+            historyList_.erase(slab_, e);
+        index_.erase(slab_[e].key_);
+        slab_.free(e);
+    }
+
+    void eraseEntry(uint32_t e) { eraseEntry(e, weigh(e)); }
+
+    // e的值即将被丢弃，移交给监听者。ghost模式下历史记录的值在暂存区中，没有暂存值时不通知
+    void releaseValue(uint32_t e, RemovalCause cause)
+    {
+        if (!listener_)
+            return;
+        if (!ghost_history_ || slab_[e].inCache())
+        {
+            listener_(slab_[e].key_, std::move(slab_[e].value_), cause);
+            return;
+        }
+        typename StagingMap::iterator it = staging_map_.find(slab_[e].key_);
+        if (it != staging_map_.end())
+            listener_(slab_[e].key_, std::move(it->second->second), cause);
+    }
+
+    // 因cause删除记录并通知，无论在哪个list中
+    void dropEntry(uint32_t e, RemovalCause cause)
+    {
+        if (on_remove_)
+            on_remove_(slab_[e].key_);
+        size_t w = weigh(e);
+        releaseValue(e, cause);
+        eraseEntry(e, w);
+    }
+
+    // e是否已到期或超过历史保留时长，只是还没有被下一次操作删除（或仍被固定）。供peek/contains使用，不修改缓存
+    bool stale(uint32_t e) const
+    {
+        if (timers_.empty() && pinned_ == 0 && !CLOCK::enabled(retained_period_))
+            return false;
+        typename CLOCK::time_point now = clock_.current();
+        if (slab_[e].expire_tick_ <= CLOCK::ticks(now))
+            return true;
+        return retentionExpired(e, now);
+    }
+
+    // e是否为最近一次访问早于保留时长的历史记录
+    bool retentionExpired(uint32_t e, typename CLOCK::time_point now) const
+    {
+        return CLOCK::enabled(retained_period_) && !slab_[e].inCache()
+            && slab_[e].access_time_.back() < CLOCK::expireBefore(now, retained_period_);
+    }
+
+    // 写入e的值后调用：按ttl重新设置到期时间，ttl为0时取消到期时间（包括固定期间已到期的标记）
+    void setExpiry(uint32_t e, typename CLOCK::time_point now, typename CLOCK::duration ttl)
+    {
+        if (CLOCK::enabled(ttl))
+            timers_.schedule(slab_, e, CLOCK::deadline(now, ttl), CLOCK::ticks(now));
+        else
+        {
+            timers_.cancel(slab_, e);
+            slab_[e].expire_tick_ = NEVER_EXPIRE;
+        }
+    }
+
+    // 固定e：第一次固定时移出堆，之后不会被选为淘汰对象
+    void pinEntry(uint32_t e)
+    {
+        if (slab_[e].pins_++ > 0)
+            return;
+        pinned_++;
+        if (slab_[e].inCache() && !lruOrdered())
+        {
+            heapErase(e);
+            slab_[e].heap_index_ = CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>::pinned_in_cache;
+        }
+    }
+
+    // 解除一次固定。最后一次解除时重新加入堆，固定期间已到期的数据此时删除，
+    // 并补做固定期间因数据无法淘汰而推迟的权重和历史容量修剪
+    void unpinEntry(uint32_t e)
+    {
+        if (--slab_[e].pins_ > 0)
+            return;
+        pinned_--;
+        if (slab_[e].heap_index_ == CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>::pinned_in_cache)
+        {
+            slab_[e].heap_index_ = CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>::npos;
+            heapPush(e);
+        }
+        if (slab_[e].expire_tick_ != NEVER_EXPIRE && !timers_.scheduled(slab_[e]))
+        {
+            dropEntry(e, RemovalCause::EXPIRED);
+            return;
+        }
+        while (!cacheList_.empty() && overWeight(cache_weight_, max_weight_))
+        {
+            uint32_t victim = findVictimFromCache();
+            if (victim == NIL_INDEX)
+                break;
+            demote(victim);
+        }
+        trimHistory();
+    }
+
+    // 删除list中满足pred(key)的记录，返回删除的个数
+    template <typename PRED>
+    size_t eraseFromList(IntrusiveList<CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>, ALLOC> &list, PRED &pred)
+    {
+        size_t erased = 0;
+        for (uint32_t i = list.front(); i != NIL_INDEX;)
+        {
+            uint32_t next = slab_[i].next_;
+            if (slab_[i].pins_ == 0 && pred(static_cast<const KEY &>(slab_[i].key_)))
+            {
+                eraseEntry(i);
+                erased++;
+            }
+            i = next;
+        }
+        return erased;
+    }
+
+    // historyList_超出条数或权重上限时从尾部丢弃，keep（位于头部）和被固定的数据不会被丢弃
+    void trimHistory(uint32_t keep = NIL_INDEX)
+    {
+        while (!historyList_.empty() && (static_cast<int>(historyList_.size()) > history_capacity_ || overWeight(history_weight_, max_history_weight_)))
+        {
+            uint32_t vict = findVictimFromHistory();
+            if (vict == keep || vict == NIL_INDEX)
+                break;
+            dropEntry(vict, RemovalCause::EVICTED);
+        }
+    }
+
+    // 从尾部丢弃最近一次访问早于保留时长的历史记录，遇到未过期的即停止，均摊O(1)；被固定的数据跳过。
+    // 从cacheList_淘汰回头部的记录不按访问时间排列，不保证在此删除：
+    // 它们被get/put访问时由getImpl/putImpl删除，peek/contains视为不存在，否则随尾部检查或容量修剪删除
+    void purgeExpiredHistory(typename CLOCK::time_point now)
+    {
+        if (!CLOCK::enabled(retained_period_))
+            return;
+        typename CLOCK::time_point deadline = CLOCK::expireBefore(now, retained_period_);
+        uint32_t i = historyList_.back();
+        while (i != NIL_INDEX && slab_[i].access_time_.back() < deadline)
+        {
+            uint32_t prev = slab_[i].prev_;
+            if (slab_[i].pins_ == 0)
+                dropEntry(i, RemovalCause::EXPIRED);
+            i = prev;
+        }
+    }
+    
+    // 缩容未完成时每次操作开始时调用，cacheList_和historyList_各最多淘汰RESIZE_STEP条数据。
+    // 未完成前capacity_/history_capacity_等于当前条数，其他操作按原有逻辑保持条数不增加
+    void shrinkStep()
+    {
+        for (int i = 0; i < RESIZE_STEP && static_cast<int>(cacheList_.size()) > target_capacity_; i++)
+        {
+            uint32_t vict = findVictimFromCache();
+            if (vict == NIL_INDEX)
+                break;
+            demote(vict);
+            trimHistory();
+        }
+        capacity_ = max(target_capacity_, static_cast<int>(cacheList_.size()));
+        for (int i = 0; i < RESIZE_STEP && static_cast<int>(historyList_.size()) > target_history_capacity_; i++)
+        {
+            uint32_t vict = findVictimFromHistory();
+            if (vict == NIL_INDEX)
+                break;
+            dropEntry(vict, RemovalCause::EVICTED);
+        }
+        history_capacity_ = max(target_history_capacity_, static_cast<int>(historyList_.size()));
+    }
+
+    // 每次操作开始时调用：读取一次时钟并丢弃过期的历史记录和到期的数据，推进未完成的缩容，返回本次操作的访问时间
+    typename CLOCK::time_point tick()
+    {
+        typename CLOCK::time_point now = clock_.now();
+        if (capacity_ > target_capacity_ || history_capacity_ > target_history_capacity_)
+            shrinkStep();
+        purgeExpiredHistory(now);
+        // 到期的记录在下一次操作开始时统一删除，没有设置存活时间的记录时不推进时间轮
+        if (!timers_.empty())
+        {
+            // 被固定的数据到期时只做标记(expire_tick_为0且不在时间轮中)，解除固定时再删除
+            auto expire = [this](uint32_t e) {
+                if (slab_[e].pins_ > 0)
+                    slab_[e].expire_tick_ = 0;
+                else
+                    dropEntry(e, RemovalCause::EXPIRED);
+            };
+            timers_.advance(slab_, CLOCK::ticks(now), expire);
+        }
+        return now;
+    }
+
+    //访问cachelist中的元素，需要更新时间，然后调整其在堆中的位置
+    void accessCacheEntry(uint32_t entry, typename CLOCK::time_point now)
+    {
+        //只记录前K次时间，记录已满时新的访问时间会覆盖最老的
+        bool rolled = slab_[entry].access_time_.full();
+        slab_[entry].access_time_.push(now);
+        if (rolled)
+        {
+            //这里由于将最老的访问时间移除了，倒数第K次访问时间变新，只需下沉该元素
+            if (lruOrdered())
+                cacheList_.move_to_front(slab_, entry);
+            else if (slab_[entry].heap_index_ != CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>::pinned_in_cache)
+                heapSiftDown(slab_[entry].heap_index_);
+        }
+    }
+
+    // 统一处理批量get中推迟的堆调整。同一记录在一组内多次访问只需下沉一次；
+    // 多个记录下沉时按堆中位置从深到浅处理，保证处理每个记录时其子树已经是合法的堆
+    void flushSifts(DeferredSift &deferred)
+    {
+        sort(deferred.entries_, deferred.entries_ + deferred.size_, greater<uint64_t>());
+        uint64_t *end = unique(deferred.entries_, deferred.entries_ + deferred.size_);
+        for (uint64_t *it = deferred.entries_; it != end; it++)
+            heapSiftDown(static_cast<size_t>(*it >> 32));
+        deferred.size_ = 0;
+    }
+
+    // get/getMany的共同实现，时间和hash由调用方提供。
+    // deferred不为NULL时cacheList_中数据的堆调整记入deferred，访问historyList_中的数据可能修改堆，之前先处理完
+    const VALUE *getImpl(typename CLOCK::time_point now, size_t h, const KEY &k, DeferredSift *deferred)
+    {
+        uint32_t *found = index_.find(k, h);
+        //未从任何缓存中找到
+        if (found == NULL)
+            return NULL;
+        uint32_t entry = *found;
+
+        // cache数据
+        if (slab_[entry].inCache())
+        {
+            if (deferred != NULL && !lruOrdered())
+            {
+                bool rolled = slab_[entry].access_time_.full();
+                slab_[entry].access_time_.push(now);
+                if (rolled && slab_[entry].heap_index_ != CacheEntry<KEY, VALUE, K, CLOCK, ALLOC>::pinned_in_cache)
+                    deferred->entries_[deferred->size_++] = (static_cast<uint64_t>(slab_[entry].heap_index_) << 32) | entry;
+            }
+            else
+                accessCacheEntry(entry, now);
+            return &slab_[entry].value_;
+        }
+
+        // 历史数据，超过保留时长的视为不存在，删除历史记录不影响堆
+        if (slab_[entry].pins_ == 0 && retentionExpired(entry, now))
+        {
+            dropEntry(entry, RemovalCause::EXPIRED);
+            return NULL;
+        }
+        if (deferred != NULL)
+            flushSifts(*deferred);
+        accessHistoryEntry(entry, now);
+        if (!ghost_history_ || slab_[entry].inCache())
+            return &slab_[entry].value_;
+        //ghost模式下值在暂存区中
+        return findStagedValue(k);
+    }
+
+    // 访问历史数据中的元素，更新时间，然后：
+    //    当热度大于等于k时，如果cachelist没有满，则将节点移入cachelist，加入堆。
+    //        如果满了则先从堆顶找到最老的数据，移回到historylist头部，再将查找的数据移入cachelist中，加入堆。
+    //    当热度小于k时：
+    //        将元素移到historylist头部。
+    // ghost模式下历史数据没有值，只有暂存区中有值或由put提供值(value_given)时才能晋升，
+    // 否则热度保持在k，等待下一次put晋升。
+    // 节点在两个list之间移动只修改前后下标，slab_中的位置不变，index_无需修改。
+    void accessHistoryEntry(uint32_t entry, typename CLOCK::time_point now, bool value_given = false)
+    {
+        CacheEntry<KEY, VALUE, K, CLOCK, ALLOC> &e = slab_[entry];
+        //只记录前K次时间
+        e.access_time_.push(now);
+        bool admit = !ghost_history_ || value_given || staging_map_.count(e.key_) > 0;
+        // cacheList_满了，需要先淘汰一个到historyList_，从cacheList_淘汰的回到历史数据头部；
+        // cacheList_中的数据都被固定时无法晋升，暂时保留在历史数据中
+        uint32_t vict = NIL_INDEX;
+        if (e.access_time_.size() >= getK() && admit && static_cast<int>(cacheList_.size()) >= capacity_)
+        {
+            vict = findVictimFromCache();
+            admit = vict != NIL_INDEX;
+        }
+        // 超过K次访问，变为热数据
+        if (e.access_time_.size() >= getK() && admit)
+        {
+            //ghost模式下暂存的值移入节点，没有暂存值时由put随后写入
+            if (ghost_history_)
+            {
+                history_weight_ -= weigh(entry);
+                unstageValue(e.key_, e.value_);
+                history_weight_ += weigh(entry);
+            }
+            //节点整体移入cacheList_，下标保持有效，无需拷贝和重新查找
+            size_t w = weigh(entry);
+            history_weight_ -= w;
+            historyList_.erase(slab_, entry);
+            if (vict != NIL_INDEX)
+                demote(vict);
+            cacheList_.push_front(slab_, entry);
+            heapPush(entry);
+            cache_weight_ += w;
+            //按权重限制时可能需要淘汰更多数据
+            shrinkCache(entry);
+            //被淘汰的数据回到历史数据后可能超出历史容量
+            trimHistory(entry);
+        }
+        // 没有超过K次，保留在历史数据中
+        else
+        {
+            // 将刚查询的entry移动到头部
+            historyList_.move_to_front(slab_, entry);
+        }
+    }
+
+    // put/emplace/try_emplace/putMany的共同实现，时间和hash由调用方提供，
+    // overwrite为false时不覆盖已有的值，返回是否写入了值。写入值时按ttl重新设置到期时间
+    template <typename... Args>
+    bool putImpl(typename CLOCK::time_point now, size_t h, bool overwrite, typename CLOCK::duration ttl, const KEY &k, Args&&... args)
+    {
+        // 一次探测得到k所在的槽位，或者k不存在时用于插入的槽位
+        index_.reserveOne();
+        bool found;
+        size_t slot = index_.probe(k, h, found);
+        uint32_t entry = NIL_INDEX;
+        if (found)
+            entry = index_.at(slot);
+        // 超过保留时长的历史记录先删除，作为新记录插入
+        if (found && slab_[entry].pins_ == 0 && retentionExpired(entry, now))
+        {
+            dropEntry(entry, RemovalCause::EXPIRED);
+            slot = index_.probe(k, h, found);
+        }
+        if (found && slab_[entry].inCache())
+        {
+            // cache数据
+            accessCacheEntry(entry, now);
+            if (overwrite)
+            {
+                cache_weight_ -= weigh(entry);
+                assignValue(slab_[entry].value_, std::forward<Args>(args)...);
+                cache_weight_ += weigh(entry);
+                setExpiry(entry, now, ttl);
+                shrinkCache(entry);
+                trimHistory(entry);
+            }
+            return overwrite;
+        }
+        if (found)
+        {
+            // 历史数据，ghost模式下只有暂存区中的才算已有值
+            bool had_value = !ghost_history_ || staging_map_.count(k) > 0;
+            accessHistoryEntry(entry, now, true);
+            if (had_value && !overwrite)
+                return false;
+            setExpiry(entry, now, ttl);
+            if (ghost_history_ && !slab_[entry].inCache())
+                stageValue(k, std::forward<Args>(args)...);
+            else
+            {
+                listWeight(entry) -= weigh(entry);
+                assignValue(slab_[entry].value_, std::forward<Args>(args)...);
+                listWeight(entry) += weigh(entry);
+                shrinkCache(entry);
+                trimHistory(entry);
+            }
+            return true;
+        }
+
+        //没有找到相同key的记录，作为新记录插入
+        //如果历史数据没有满，则直接插入
+        //如果历史数据满了，则淘汰最老的记录
+        //删除可能把探测链上的槽位置空，此时用同一个hash重新定位插入槽位
+        //历史数据都被固定时暂时超出上限插入
+        if (!historyList_.empty() && static_cast<int>(historyList_.size()) >= history_capacity_)
+        {
+            while (!historyList_.empty() && static_cast<int>(historyList_.size()) >= history_capacity_)
+            {
+                uint32_t victim = findVictimFromHistory();
+                if (victim == NIL_INDEX)
+                    break;
+                dropEntry(victim, RemovalCause::EVICTED);
+            }
+            slot = index_.probe(k, h, found);
+        }
+
+        //插入新记录，ghost模式下值只进入暂存区
+        if (ghost_history_)
+        {
+            entry = slab_.allocate(k, getK(), alloc_);
+            stageValue(k, std::forward<Args>(args)...);
+        }
+        else
+            entry = slab_.allocate(k, getK(), alloc_, std::forward<Args>(args)...);
+        historyList_.push_front(slab_, entry);
+        slab_[entry].access_time_.push(now);
+        index_.insertAt(slot, h, entry);
+        history_weight_ += weigh(entry);
+        setExpiry(entry, now, ttl);
+        trimHistory(entry);
+
+        return true;
+    }
+
+public:
+    LRUK_Cache(int c, int k, const ALLOC &alloc = ALLOC())
+        : LRUK_Cache(c, k, c, typename CLOCK::duration(), false, 0, alloc) {}
+
+    // 编译期确定K时使用
+    explicit LRUK_Cache(int c, const ALLOC &alloc = ALLOC()) : LRUK_Cache(c, K, alloc) { static_assert(K > 0, "LRUK_Cache(int) requires a compile-time K"); }
+
+    // ghost模式：historyList_中只保存key和访问时间，未晋升数据的值最多保存staging_capacity个
+    LRUK_Cache(int c, int k, bool ghost_history, int staging_capacity, const ALLOC &alloc = ALLOC())
+        : LRUK_Cache(c, k, c, typename CLOCK::duration(), ghost_history, staging_capacity, alloc) {}
+
+    // 历史记录与缓存数据分开限制：historyList_最多保存history_capacity条记录，
+    // 最近一次访问早于retained_period之前的历史记录会被丢弃（即LRU-K论文中的Retained Information Period），
+    // peek/contains/get立即视为不存在，记录本身在下一次被访问或检查到historyList_尾部时删除
+    LRUK_Cache(int c, int k, int history_capacity, typename CLOCK::duration retained_period,
+               bool ghost_history = false, int staging_capacity = 0, const ALLOC &alloc = ALLOC())
+        : capacity_(c), k_(k), history_capacity_(history_capacity), retained_period_(retained_period),
+          target_capacity_(c), target_history_capacity_(history_capacity), alloc_(alloc), slab_(alloc), index_(EntryKey(&slab_), alloc), cacheHeap_(alloc),
+          ghost_history_(ghost_history), staging_capacity_(staging_capacity),
+          stagingList_(alloc), staging_map_(0, hash<KEY>(), equal_to<KEY>(), alloc),
+          notify_demotion_(false), max_weight_(0), max_history_weight_(0), cache_weight_(0), history_weight_(0), pinned_(0), default_ttl_() { init(); }
+
+    // 查找k并记录一次访问，返回指向缓存中值的指针，未找到返回NULL。
+    // 不拷贝值，指针在下一次修改缓存的调用(get/put/clear)之前有效。
+    const VALUE *get(const KEY &k)
+    {
+        return getImpl(tick(), index_.hashOf(k), k, NULL);
+    }
+
+    VALUE get(const KEY &k, bool &found)
+    {
+        const VALUE *v = get(k);
+        found = v != NULL;
+        return found ? *v : VALUE();
+    }
+
+    void put(const KEY &k, const VALUE &v) { emplace(k, v); }
+
+    void put(const KEY &k, VALUE &&v) { emplace(k, std::move(v)); }
+
+    // 写入k并单独指定存活时间：写入ttl之后过期，为0表示不过期
+    void put(const KEY &k, const VALUE &v, typename CLOCK::duration ttl) { putImpl(tick(), index_.hashOf(k), true, ttl, k, v); }
+
+    void put(const KEY &k, VALUE &&v, typename CLOCK::duration ttl) { putImpl(tick(), index_.hashOf(k), true, ttl, k, std::move(v)); }
+
+    // 以args原地构造k的值，已存在则覆盖
+    template <typename... Args>
+    void emplace(const KEY &k, Args&&... args)
+    {
+        putImpl(tick(), index_.hashOf(k), true, default_ttl_, k, std::forward<Args>(args)...);
+    }
+
+    // k已有值时只记录一次访问，不构造也不修改值，返回false；否则以args原地构造值，返回true
+    template <typename... Args>
+    bool try_emplace(const KEY &k, Args&&... args)
+    {
+        return putImpl(tick(), index_.hashOf(k), false, default_ttl_, k, std::forward<Args>(args)...);
+    }
+
+    // 批量查找keys[0..n)，命中时values[i]为值的拷贝、found[i]为true，未命中时values[i]不变，返回命中个数。
+    // 整批只读取一次时钟，同一批的访问时间相同；每BATCH_SIZE个key为一组，先计算hash并预取索引槽位和记录，
+    // 缓存较大时组内cacheList_中数据的堆调整推迟到组末统一进行
+    size_t getMany(const KEY *keys, size_t n, VALUE *values, bool *found)
+    {
+        typename CLOCK::time_point now = tick();
+        size_t hashes[BATCH_SIZE];
+        DeferredSift deferred;
+        bool defer = cacheHeap_.size() >= DEFER_SIFT_MIN;
+        size_t hits = 0;
+        for (size_t begin = 0; begin < n; begin += BATCH_SIZE)
+        {
+            size_t count = min(n - begin, static_cast<size_t>(BATCH_SIZE));
+            for (size_t j = 0; j < count; j++)
+            {
+                hashes[j] = index_.hashOf(keys[begin + j]);
+                index_.prefetch(hashes[j]);
+            }
+            for (size_t j = 0; j < count; j++)
+            {
+                const uint32_t *e = index_.hint(hashes[j]);
+                if (e != NULL)
+                    prefetchAddress(&slab_[*e]);
+            }
+            for (size_t j = 0; j < count; j++)
+            {
+                const VALUE *v = getImpl(now, hashes[j], keys[begin + j], defer ? &deferred : NULL);
+                found[begin + j] = v != NULL;
+                if (v != NULL)
+                {
+                    values[begin + j] = *v;
+                    hits++;
+                }
+            }
+            flushSifts(deferred);
+        }
+        return hits;
+    }
+
+    // 批量写入keys[i] -> values[i]，已存在则覆盖。与getMany一样只读取一次时钟并按组预取，
+    // 但写入可能淘汰数据，需要合法的堆，因此每个key的堆调整立即进行
+    void putMany(const KEY *keys, const VALUE *values, size_t n)
+    {
+        typename CLOCK::time_point now = tick();
+        size_t hashes[BATCH_SIZE];
+        for (size_t begin = 0; begin < n; begin += BATCH_SIZE)
+        {
+            size_t count = min(n - begin, static_cast<size_t>(BATCH_SIZE));
+            for (size_t j = 0; j < count; j++)
+            {
+                hashes[j] = index_.hashOf(keys[begin + j]);
+                index_.prefetch(hashes[j]);
+            }
+            for (size_t j = 0; j < count; j++)
+                putImpl(now, hashes[j], true, default_ttl_, keys[begin + j], values[begin + j]);
+        }
+    }
+
+    // 查看k的值但不记录访问：不读取时钟的访问计数、不修改访问时间和淘汰顺序，也不删除任何数据，
+    // 因此多个线程可以在共享锁下同时调用。已到期但尚未删除的数据视为不存在。
+    // 返回的指针在下一次修改缓存的调用之前有效，ghost模式下没有暂存值的历史记录返回NULL
+    const VALUE *peek(const KEY &k) const
+    {
+        const uint32_t *found = index_.find(k, index_.hashOf(k));
+        if (found == NULL || stale(*found))
+            return NULL;
+        const CacheEntry<KEY, VALUE, K, CLOCK, ALLOC> &e = slab_[*found];
+        if (!ghost_history_ || e.inCache())
+            return &e.value_;
+        typename StagingMap::const_iterator it = staging_map_.find(k);
+        return it == staging_map_.end() ? NULL : &it->second->second;
+    }
+
+    // k是否在缓存中（包括只有访问记录的历史数据），与peek一样不记录访问
+    bool contains(const KEY &k) const
+    {
+        const uint32_t *found = index_.find(k, index_.hashOf(k));
+        return found != NULL && !stale(*found);
+    }
+
+    // pin返回的句柄，持有期间对应数据不会被淘汰、降级、过期删除或erase，析构或reset时解除固定。
+    // 只保存记录下标，每次访问时重新定位，其他操作使slab_扩容移动记录后仍然有效。
+    // 通过句柄只能读取值，修改需要put，由缓存重新计算权重。句柄只能移动，必须在缓存析构或clear()之前释放
+    class Pinned
+    {
+        LRUK_Cache *cache_;
+        uint32_t entry_;
+
+        Pinned(const Pinned &);
+        Pinned &operator=(const Pinned &);
+
+        friend class LRUK_Cache;
+        Pinned(LRUK_Cache *cache, uint32_t entry) : cache_(cache), entry_(entry) {}
+
+    public:
+        Pinned() : cache_(NULL), entry_(NIL_INDEX) {}
+
+        Pinned(Pinned &&other) noexcept : cache_(other.cache_), entry_(other.entry_) { other.cache_ = NULL; }
+
+        Pinned &operator=(Pinned &&other)
+        {
+            if (this != &other)
+            {
+                reset();
+                cache_ = other.cache_;
+                entry_ = other.entry_;
+                other.cache_ = NULL;
+            }
+            return *this;
+        }
+
+        ~Pinned() { reset(); }
+
+        void reset()
+        {
+            if (cache_ == NULL)
+                return;
+            cache_->unpinEntry(entry_);
+            cache_ = NULL;
+        }
+
+        explicit operator bool() const { return cache_ != NULL; }
+
+        const KEY &key() const { return cache_->slab_[entry_].key_; }
+        const VALUE &value() const { return cache_->slab_[entry_].value_; }
+        const VALUE &operator*() const { return value(); }
+        const VALUE *operator->() const { return &value(); }
+    };
+
+    // 查找k并记录一次访问，返回固定k的句柄，未找到时句柄为空。同一数据可以同时被多个句柄固定，
+    // 全部释放后才重新参与淘汰；固定期间到期的数据仍可访问，最后一个句柄释放时删除。
+    // ghost模式下历史数据的值在暂存区中，只能固定cacheList_中的数据。
+    // 固定的数据不能淘汰，缓存可能暂时超出上限：cacheList_中都被固定时新数据无法晋升，
+    // 权重和historyList_的条数在句柄释放时再修剪
+    Pinned pin(const KEY &k)
+    {
+        size_t h = index_.hashOf(k);
+        if (getImpl(tick(), h, k, NULL) == NULL)
+            return Pinned();
+        uint32_t entry = *index_.find(k, h);
+        if (ghost_history_ && !slab_[entry].inCache())
+            return Pinned();
+        pinEntry(entry);
+        return Pinned(this, entry);
+    }
+
+    // 当前被固定的数据条数
+    size_t pinnedCount() const { return pinned_; }
+
+    // 删除k的值和访问记录，之后再访问k等同于第一次访问，返回是否删除。
+    // 与clear()一样属于主动删除，不触发移除回调。被固定的数据不会被删除，erase_if系列同样跳过
+    bool erase(const KEY &k)
+    {
+        uint32_t *found = index_.find(k, index_.hashOf(k));
+        if (found == NULL || slab_[*found].pins_ > 0)
+            return false;
+        // ghost模式下暂存区的值都有对应的历史记录，随记录一起删除
+        eraseEntry(*found);
+        return true;
+    }
+
+    // 删除所有满足pred(key)的数据，返回删除的个数。遍历所有记录，O(n)，其余数据的淘汰顺序不变
+    template <typename PRED>
+    size_t erase_if(PRED pred)
+    {
+        size_t erased = eraseFromList(cacheList_, pred);
+        return erased + eraseFromList(historyList_, pred);
+    }
+
+    // 删除key在[first, last)范围内的数据，KEY需要支持operator<
+    size_t erase_range(const KEY &first, const KEY &last)
+    {
+        return erase_if([&](const KEY &k) { return !(k < first) && k < last; });
+    }
+
+    // 删除key以prefix开头的数据，KEY需要是string之类支持compare(pos, len, str)的类型
+    size_t erase_prefix(const KEY &prefix)
+    {
+        return erase_if([&](const KEY &k) { return k.compare(0, prefix.size(), prefix) == 0; });
+    }
+
+    // 设置key被彻底移出缓存时的回调，clear()和erase系列不会触发
+    void setRemovalCallback(const function<void(const KEY &)> &cb)
+    {
+        on_remove_ = cb;
+    }
+
+    // 设置值离开缓存时的监听者，参数为key、值和原因。EVICTED和EXPIRED时值随后被丢弃，监听者可以直接移走，不会拷贝；
+    // DEMOTED时值仍保留在historyList_（ghost模式下为暂存区）中，监听者收到的是拷贝，只在notify_demotion为true
+    // 且VALUE可拷贝时通知。ghost模式下没有值的历史记录被丢弃时不通知，erase和clear不通知；
+    // 暂存区容量为0时值无法保留，淘汰回historyList_或写入历史记录时以EVICTED通知。
+    // 监听者在缓存操作内部同步调用，不能再访问缓存，也不能抛出异常
+    void setRemovalListener(const function<void(const KEY &, VALUE &&, RemovalCause)> &listener, bool notify_demotion = false)
+    {
+        listener_ = listener;
+        notify_demotion_ = notify_demotion;
+    }
+
+    // 设置权重计算函数，cacheList_和historyList_按总权重限制（为0表示不限制），条数上限仍然有效。
+    // 超出时按K距离淘汰缓存数据、从尾部丢弃历史记录；单条权重超过max_weight的数据不会留在cacheList_中。
+    // ghost模式下历史记录不保存值，其权重只按key计算
+    void setWeigher(const function<size_t(const KEY &, const VALUE &)> &weigher, size_t max_weight, size_t max_history_weight = 0)
+    {
+        weigher_ = weigher;
+        max_weight_ = max_weight;
+        max_history_weight_ = max_history_weight;
+        cache_weight_ = history_weight_ = 0;
+        for (uint32_t i = cacheList_.front(); i != NIL_INDEX; i = slab_[i].next_)
+            cache_weight_ += weigh(i);
+        for (uint32_t i = historyList_.front(); i != NIL_INDEX; i = slab_[i].next_)
+            history_weight_ += weigh(i);
+        while (!cacheList_.empty() && overWeight(cache_weight_, max_weight_))
+        {
+            uint32_t victim = findVictimFromCache();
+            if (victim == NIL_INDEX)
+                break;
+            demote(victim);
+        }
+        trimHistory();
+    }
+
+    // 设置默认存活时间：之后put/emplace/try_emplace/putMany写入的数据在写入ttl之后过期，为0表示不过期（默认）。
+    // 每次写入都会重新计算到期时间，get不会延长。已有数据的到期时间不变
+    void setDefaultTTL(typename CLOCK::duration ttl) { default_ttl_ = ttl; }
+
+    // 立即删除已到期的数据和超过保留时长的历史记录，返回删除的条数。get/put开始时也会删除，
+    // 长时间没有访问时可定期调用以释放内存。逻辑时钟下本身也计为一次访问
+    size_t removeExpired()
+    {
+        size_t entries = slab_.size();
+        tick();
+        return entries - slab_.size();
+    }
+
+    // 调整cacheList_的容量，保留所有数据和访问记录。扩容立即生效，内存随数据增加按需分配；
+    // 缩容时超出的数据不会一次性淘汰，之后每次操作开始时按K距离淘汰最多RESIZE_STEP条移回historyList_，
+    // 直到不超过新容量，期间条数不会再增加
+    void setCapacity(int c)
+    {
+        assert(c > 0);
+        target_capacity_ = c;
+        capacity_ = max(c, static_cast<int>(cacheList_.size()));
+    }
+
+    // 调整historyList_的容量，缩容时同样每次操作最多从尾部丢弃RESIZE_STEP条
+    void setHistoryCapacity(int history_capacity)
+    {
+        assert(history_capacity >= 0);
+        target_history_capacity_ = history_capacity;
+        history_capacity_ = max(history_capacity, static_cast<int>(historyList_.size()));
+    }
+
+    int capacity() const { return target_capacity_; }
+    int historyCapacity() const { return target_history_capacity_; }
+
+    // cacheList_和historyList_当前的总权重，未设置权重函数时即为记录条数
+    size_t weight() const { return cache_weight_; }
+    size_t historyWeight() const { return history_weight_; }
+
+    // 调用时不能有未释放的Pinned句柄
+    void clear()
+    {
+        assert(pinned_ == 0);
+        index_.clear();
+        historyList_.clear();
+        cacheHeap_.clear();
+        cacheList_.clear();
+        slab_.clear();
+        timers_.clear();
+        staging_map_.clear();
+        stagingList_.clear();
+        cache_weight_ = history_weight_ = 0;
+        capacity_ = target_capacity_;
+        history_capacity_ = target_history_capacity_;
+    }
+
+    // 检查内部结构是否一致：索引、两个list、堆、权重、固定计数和时间轮，O(n)，供自检使用
+    void checkInvariants() const
+    {
+        assert(index_.size() == slab_.size());
+        assert(slab_.size() == cacheList_.size() + historyList_.size());
+        assert(static_cast<int>(cacheList_.size()) <= capacity_);
+        size_t cache_weight = 0, history_weight = 0, pinned = 0, scheduled = 0;
+        for (uint32_t i = cacheList_.front(); i != NIL_INDEX; i = slab_[i].next_)
+        {
+            const CacheEntry<KEY, VALUE, K, CLOCK, ALLOC> &e = slab_[i];
+            const uint32_t *found = index_.find(e.key_, index_.hashOf(e.key_));
+            assert(found != NULL && *found == i && e.inCache());
+            if (lruOrdered())
+                assert(e.next_ == NIL_INDEX || !(e.access_time_.back() < slab_[e.next_].access_time_.back()));
+            else if (e.pins_ == 0)
+                assert(e.heap_index_ < cacheHeap_.size() && cacheHeap_[e.heap_index_] == i);
+            cache_weight += weigh(i);
+            pinned += e.pins_ > 0;
+            scheduled += timers_.scheduled(e);
+            (void)found;
+        }
+        if (!lruOrdered())
+            assert(cacheHeap_.size() + pinned == cacheList_.size());
+        for (size_t j = 1; j < cacheHeap_.size(); j++)
+            assert(!heapBefore(cacheHeap_[j], cacheHeap_[(j - 1) / 2]));
+        for (uint32_t i = historyList_.front(); i != NIL_INDEX; i = slab_[i].next_)
+        {
+            const CacheEntry<KEY, VALUE, K, CLOCK, ALLOC> &e = slab_[i];
+            const uint32_t *found = index_.find(e.key_, index_.hashOf(e.key_));
+            assert(found != NULL && *found == i && !e.inCache());
+            history_weight += weigh(i);
+            pinned += e.pins_ > 0;
+            scheduled += timers_.scheduled(e);
+            (void)found;
+        }
+        assert(cache_weight == cache_weight_ && history_weight == history_weight_);
+        assert(pinned == pinned_ && scheduled == timers_.size());
+        // ghost模式下暂存的值都属于historyList_中的记录
+        assert(stagingList_.size() == staging_map_.size());
+        for (typename StagingList::const_iterator it = stagingList_.begin(); it != stagingList_.end(); it++)
+        {
+            const uint32_t *found = index_.find(it->first, index_.hashOf(it->first));
+            assert(found != NULL && !slab_[*found].inCache());
+            (void)found;
+        }
+        (void)cache_weight;
+        (void)history_weight;
+    }
+
+    void print()
+    {
+        string msg;
+        if (cacheList_.size() > 0)
+        {
+            msg += "cacheList:\n";
+            int num = 0;
+            // cacheList_本身无序，打印时按时间从新到旧的顺序输出
+            vector<const CacheEntry<KEY, VALUE, K, CLOCK, ALLOC> *> sorted;
+            for (uint32_t i = cacheList_.front(); i != NIL_INDEX; i = slab_[i].next_)
+                sorted.push_back(&slab_[i]);
+            sort(sorted.begin(), sorted.end(), compareIterByAccessTime<const CacheEntry<KEY, VALUE, K, CLOCK, ALLOC> *>);
+            typename vector<const CacheEntry<KEY, VALUE, K, CLOCK, ALLOC> *>::iterator sit = sorted.begin();
+            for (; sit != sorted.end(); sit++)
+            {
+                const CacheEntry<KEY, VALUE, K, CLOCK, ALLOC> *it = *sit;
+                msg += "[";
+                msg += to_string(num);
+                msg += "] key=";
+                msg += to_string_if_not_string(it->key_);
+                msg += ", ";
+                msg += "value=";
+                msg += to_string_if_not_string(it->value_);
+                msg += "\n";
+                num++;
+            }
+        }
+        else
+            msg += "cacheList is empty.\n";
+
+        if (historyList_.size() > 0)
+        {
+            msg += "historyList:\n";
+            int num = 0;
+            for (uint32_t i = historyList_.front(); i != NIL_INDEX; i = slab_[i].next_)
+            {
+                const CacheEntry<KEY, VALUE, K, CLOCK, ALLOC> *it = &slab_[i];
+                msg += "[";
+                msg += to_string(num);
+                msg += "] key=";
+                msg += to_string_if_not_string(it->key_);
+                msg += ", ";
+                msg += "value=";
+                if (ghost_history_)
+                {
+                    typename StagingMap::const_iterator sit = staging_map_.find(it->key_);
+                    if (sit != staging_map_.end())
+                        msg += to_string_if_not_string(sit->second->second);
+                    else
+                        msg += "(ghost)";
+                }
+                else
+                    msg += to_string_if_not_string(it->value_);
+                msg += "\n";
+                num++;
+            }
+        }
+        else
+            msg += "historyList is empty.\n";
+
+        cout<<msg;
+    }
+};
+
+// get_or_load的统计
+struct LoadStats
+{
+    uint64_t hits_;       // 缓存命中，未调用加载函数
+    uint64_t loads_;      // 调用加载函数的次数
+    uint64_t coalesced_;  // 未命中但等待了同一key正在进行的加载，没有再次调用加载函数
+    uint64_t failures_;   // 加载函数抛出异常的次数
+
+    LoadStats() : hits_(0), loads_(0), coalesced_(0), failures_(0) {}
+};
+
+// 线程安全的LRU-K缓存：按key的hash分成多个互不相关的LRUK_Cache分片，每个分片有自己的锁，
+// 不同分片上的操作可以并行。每个分片内部仍是完整的LRU-K语义，容量平均分配给各分片。
+template <typename KEY, typename VALUE, size_t K = 0, typename CLOCK = LogicalClock>
+class ShardedLRUK_Cache
+{
+    // 一次正在进行的get_or_load加载，同一key的其他请求等待其结果。成员由所在分片的锁保护
+    struct Flight
+    {
+        condition_variable done_cv_;
+        bool done_;
+        VALUE value_;
+        exception_ptr error_;  // 加载函数抛出的异常，转交给所有等待者
+        bool invalidated_;     // 加载期间key被erase，加载结果只返回给调用者，不写入缓存
+
+        Flight() : done_(false), invalidated_(false) {}
+    };
+
+    // 值离开缓存的事件，在分片的锁内记录，释放锁后交付给监听者
+    struct RemovalEvent
+    {
+        KEY key_;
+        VALUE value_;
+        RemovalCause cause_;
+
+        RemovalEvent(const KEY &k, VALUE &&v, RemovalCause cause) : key_(k), value_(std::move(v)), cause_(cause) {}
+    };
+
+    struct Shard
+    {
+        mutex lock_;
+        LRUK_Cache<KEY, VALUE, K, CLOCK> cache_;
+        unordered_map<KEY, shared_ptr<Flight> > flights_;  // 正在加载的key
+        LoadStats stats_;
+        vector<RemovalEvent> events_;                      // 尚未交付的事件
+
+        Shard(int c, int k, int history_capacity, typename CLOCK::duration retained_period,
+              bool ghost_history, int staging_capacity)
+            : cache_(c, k, history_capacity, retained_period, ghost_history, staging_capacity) {}
+    };
+
+    vector<unique_ptr<Shard> > shards_;
+    hash<KEY> hasher_;
+    function<void(const KEY &, VALUE &&, RemovalCause)> listener_;
+
+    // 持有分片的锁，析构时先释放锁，再在锁外把期间记录的事件批量交付给监听者。
+    // 事件属于分片，由之后第一个释放该分片锁的操作交付
+    class ShardGuard
+    {
+        ShardedLRUK_Cache &owner_;
+        Shard &shard_;
+        unique_lock<mutex> lock_;
+
+        ShardGuard(const ShardGuard &);
+        ShardGuard &operator=(const ShardGuard &);
+
+    public:
+        ShardGuard(ShardedLRUK_Cache &owner, Shard &shard) : owner_(owner), shard_(shard), lock_(shard.lock_) {}
+
+        ~ShardGuard()
+        {
+            if (shard_.events_.empty())
+                return;
+            vector<RemovalEvent> events;
+            events.swap(shard_.events_);
+            lock_.unlock();
+            for (size_t i = 0; i < events.size(); i++)
+                owner_.listener_(events[i].key_, std::move(events[i].value_), events[i].cause_);
+        }
+
+        unique_lock<mutex> &lock() { return lock_; }
+    };
+
+    Shard &shardFor(const KEY &k)
+    {
+        // 分片内的FlatIndex对hash另做一次mix()，取低位定位槽位、最高7位作控制字节；这里用不同的乘法打散后
+        // 取高32位选择分片，使同一分片内的key在FlatIndex中仍然均匀分布
+        uint64_t h = static_cast<uint64_t>(hasher_(k)) * 0x9E3779B97F4A7C15ULL;
+        return *shards_[(h >> 32) % shards_.size()];
+    }
+
+    void init(int shards, int c, int k, int history_capacity, typename CLOCK::duration retained_period,
+              bool ghost_history, int staging_capacity)
+    {
+        assert(shards > 0);
+        int shard_capacity = (c + shards - 1) / shards;
+        int shard_history_capacity = (history_capacity + shards - 1) / shards;
+        int shard_staging_capacity = (staging_capacity + shards - 1) / shards;
+        for (int i = 0; i < shards; i++)
+            shards_.push_back(unique_ptr<Shard>(new Shard(shard_capacity, k, shard_history_capacity, retained_period,
+                                                          ghost_history, shard_staging_capacity)));
+    }
+
+public:
+    // 总容量为c，均分到shards个分片
+    ShardedLRUK_Cache(int shards, int c, int k)
+    {
+        init(shards, c, k, c, typename CLOCK::duration(), false, 0);
+    }
+
+    ShardedLRUK_Cache(int shards, int c, int k, int history_capacity, typename CLOCK::duration retained_period,
+                      bool ghost_history = false, int staging_capacity = 0)
+    {
+        init(shards, c, k, history_capacity, retained_period, ghost_history, staging_capacity);
+    }
+
+    // 返回值的拷贝，释放锁之后缓存中的值可能随时被淘汰，因此不提供指针版本
+    VALUE get(const KEY &k, bool &found)
+    {
+        Shard &shard = shardFor(k);
+        ShardGuard guard(*this, shard);
+        return shard.cache_.get(k, found);
+    }
+
+    // 返回值的拷贝但不记录访问，见LRUK_Cache::peek
+    VALUE peek(const KEY &k, bool &found)
+    {
+        Shard &shard = shardFor(k);
+        lock_guard<mutex> guard(shard.lock_);
+        const VALUE *v = shard.cache_.peek(k);
+        found = v != NULL;
+        return found ? *v : VALUE();
+    }
+
+    bool contains(const KEY &k)
+    {
+        Shard &shard = shardFor(k);
+        lock_guard<mutex> guard(shard.lock_);
+        return shard.cache_.contains(k);
+    }
+
+    void put(const KEY &k, const VALUE &v)
+    {
+        Shard &shard = shardFor(k);
+        ShardGuard guard(*this, shard);
+        shard.cache_.put(k, v);
+    }
+
+    void put(const KEY &k, VALUE &&v)
+    {
+        Shard &shard = shardFor(k);
+        ShardGuard guard(*this, shard);
+        shard.cache_.put(k, std::move(v));
+    }
+
+    void put(const KEY &k, const VALUE &v, typename CLOCK::duration ttl)
+    {
+        Shard &shard = shardFor(k);
+        ShardGuard guard(*this, shard);
+        shard.cache_.put(k, v, ttl);
+    }
+
+    template <typename... Args>
+    void emplace(const KEY &k, Args&&... args)
+    {
+        Shard &shard = shardFor(k);
+        ShardGuard guard(*this, shard);
+        shard.cache_.emplace(k, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    bool try_emplace(const KEY &k, Args&&... args)
+    {
+        Shard &shard = shardFor(k);
+        ShardGuard guard(*this, shard);
+        return shard.cache_.try_emplace(k, std::forward<Args>(args)...);
+    }
+
+    // 读穿透：命中时返回缓存中的值；未命中时调用loader(k)加载并写入缓存。
+    // 同一key同时只有一个线程调用loader，其他线程等待并共享其结果（或其抛出的异常），
+    // 加载期间不持有分片的锁。加载期间其他线程put的值优先保留，不会被加载结果覆盖
+    template <typename LOADER>
+    VALUE get_or_load(const KEY &k, LOADER loader)
+    {
+        Shard &shard = shardFor(k);
+        shared_ptr<Flight> flight;
+        {
+            ShardGuard guard(*this, shard);
+            const VALUE *v = shard.cache_.get(k);
+            if (v != NULL)
+            {
+                shard.stats_.hits_++;
+                return *v;
+            }
+            typename unordered_map<KEY, shared_ptr<Flight> >::iterator it = shard.flights_.find(k);
+            if (it != shard.flights_.end())
+            {
+                flight = it->second;
+                shard.stats_.coalesced_++;
+                while (!flight->done_)
+                    flight->done_cv_.wait(guard.lock());
+                if (flight->error_)
+                    rethrow_exception(flight->error_);
+                return flight->value_;
+            }
+            flight = make_shared<Flight>();
+            shard.flights_.emplace(k, flight);
+            shard.stats_.loads_++;
+        }
+
+        VALUE value;
+        try
+        {
+            value = loader(k);
+        }
+        catch (...)
+        {
+            ShardGuard guard(*this, shard);
+            shard.stats_.failures_++;
+            flight->error_ = current_exception();
+            flight->done_ = true;
+            shard.flights_.erase(k);
+            flight->done_cv_.notify_all();
+            throw;
+        }
+
+        ShardGuard guard(*this, shard);
+        if (!flight->invalidated_)
+            shard.cache_.try_emplace(k, value);
+        flight->value_ = value;
+        flight->done_ = true;
+        shard.flights_.erase(k);
+        flight->done_cv_.notify_all();
+        return value;
+    }
+
+    // 删除k，返回k是否存在。k正在被get_or_load加载时，加载结果不再写入缓存
+    bool erase(const KEY &k)
+    {
+        Shard &shard = shardFor(k);
+        ShardGuard guard(*this, shard);
+        typename unordered_map<KEY, shared_ptr<Flight> >::iterator it = shard.flights_.find(k);
+        if (it != shard.flights_.end())
+            it->second->invalidated_ = true;
+        return shard.cache_.erase(k);
+    }
+
+    // 依次在各分片的锁内删除满足pred(key)的数据，返回删除的个数，pred会在不同分片的锁内调用
+    template <typename PRED>
+    size_t erase_if(PRED pred)
+    {
+        size_t erased = 0;
+        for (size_t i = 0; i < shards_.size(); i++)
+        {
+            Shard &shard = *shards_[i];
+            ShardGuard guard(*this, shard);
+            typename unordered_map<KEY, shared_ptr<Flight> >::iterator it = shard.flights_.begin();
+            for (; it != shard.flights_.end(); it++)
+            {
+                if (pred(static_cast<const KEY &>(it->first)))
+                    it->second->invalidated_ = true;
+            }
+            erased += shard.cache_.erase_if(pred);
+        }
+        return erased;
+    }
+
+    size_t erase_range(const KEY &first, const KEY &last)
+    {
+        return erase_if([&](const KEY &k) { return !(k < first) && k < last; });
+    }
+
+    size_t erase_prefix(const KEY &prefix)
+    {
+        return erase_if([&](const KEY &k) { return k.compare(0, prefix.size(), prefix) == 0; });
+    }
+
+    // 各分片get_or_load统计之和
+    LoadStats loadStats()
+    {
+        LoadStats total;
+        for (size_t i = 0; i < shards_.size(); i++)
+        {
+            lock_guard<mutex> guard(shards_[i]->lock_);
+            total.hits_ += shards_[i]->stats_.hits_;
+            total.loads_ += shards_[i]->stats_.loads_;
+            total.coalesced_ += shards_[i]->stats_.coalesced_;
+            total.failures_ += shards_[i]->stats_.failures_;
+        }
+        return total;
+    }
+
+    // 权重上限均分到各分片，weigher会在不同分片的锁内并发调用
+    void setWeigher(const function<size_t(const KEY &, const VALUE &)> &weigher, size_t max_weight, size_t max_history_weight = 0)
+    {
+        size_t n = shards_.size();
+        for (size_t i = 0; i < n; i++)
+        {
+            ShardGuard guard(*this, *shards_[i]);
+            shards_[i]->cache_.setWeigher(weigher, (max_weight + n - 1) / n, (max_history_weight + n - 1) / n);
+        }
+    }
+
+    // 设置值离开缓存时的监听者，含义见LRUK_Cache::setRemovalListener。事件在分片的锁内记录，
+    // 由触发事件的操作释放锁之后批量交付，因此监听者可以访问缓存；不同分片的事件可能在不同线程上同时交付。
+    // 需在开始并发访问之前设置
+    void setRemovalListener(const function<void(const KEY &, VALUE &&, RemovalCause)> &listener, bool notify_demotion = false)
+    {
+        listener_ = listener;
+        for (size_t i = 0; i < shards_.size(); i++)
+        {
+            Shard &shard = *shards_[i];
+            lock_guard<mutex> guard(shard.lock_);
+            if (listener)
+                shard.cache_.setRemovalListener([&shard](const KEY &k, VALUE &&v, RemovalCause cause) {
+                    shard.events_.push_back(RemovalEvent(k, std::move(v), cause));
+                }, notify_demotion);
+            else
+                shard.cache_.setRemovalListener(function<void(const KEY &, VALUE &&, RemovalCause)>());
+        }
+    }
+
+    // 总容量均分到各分片，各分片缩容在各自的后续操作中逐步完成
+    void setCapacity(int c)
+    {
+        int n = static_cast<int>(shards_.size());
+        for (int i = 0; i < n; i++)
+        {
+            lock_guard<mutex> guard(shards_[i]->lock_);
+            shards_[i]->cache_.setCapacity((c + n - 1) / n);
+        }
+    }
+
+    void setHistoryCapacity(int history_capacity)
+    {
+        int n = static_cast<int>(shards_.size());
+        for (int i = 0; i < n; i++)
+        {
+            lock_guard<mutex> guard(shards_[i]->lock_);
+            shards_[i]->cache_.setHistoryCapacity((history_capacity + n - 1) / n);
+        }
+    }
+
+    void setDefaultTTL(typename CLOCK::duration ttl)
+    {
+        for (size_t i = 0; i < shards_.size(); i++)
+        {
+            lock_guard<mutex> guard(shards_[i]->lock_);
+            shards_[i]->cache_.setDefaultTTL(ttl);
+        }
+    }
+
+    // 依次删除各分片中已到期的数据，返回删除的条数
+    size_t removeExpired()
+    {
+        size_t removed = 0;
+        for (size_t i = 0; i < shards_.size(); i++)
+        {
+            ShardGuard guard(*this, *shards_[i]);
+            removed += shards_[i]->cache_.removeExpired();
+        }
+        return removed;
+    }
+
+    // 各分片cacheList_总权重之和
+    size_t weight()
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < shards_.size(); i++)
+        {
+            lock_guard<mutex> guard(shards_[i]->lock_);
+            total += shards_[i]->cache_.weight();
+        }
+        return total;
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < shards_.size(); i++)
+        {
+            lock_guard<mutex> guard(shards_[i]->lock_);
+            shards_[i]->cache_.clear();
+        }
+    }
+
+    void print()
+    {
+        for (size_t i = 0; i < shards_.size(); i++)
+        {
+            lock_guard<mutex> guard(shards_[i]->lock_);
+            cout << "shard " << i << ":\n";
+            shards_[i]->cache_.print();
+        }
+    }
+};
+
+#if __cplusplus >= 201703L
+// 基于epoch的内存回收（需要C++17），供无锁读取的数据结构延迟释放被替换下来的对象。
+// 读取方在Guard期间把全局epoch登记在本线程的记录中；写入方把对象从数据结构中摘下后按当时的全局epoch标记，
+// advance()推进全局epoch并返回正在读取的线程登记的最小epoch，标记小于它的对象不会再被任何读取访问，可以释放。
+// 每个线程第一次读取时领取一条按缓存行对齐的记录，读取只写自己的记录，不写其他线程会读写的数据；
+// 线程退出时记录交还给之后的线程复用，记录本身从不释放。所有缓存实例共用instance()这一个域
+class EpochDomain
+{
+public:
+    struct alignas(64) Record
+    {
+        atomic<uint64_t> epoch_;  // 正在读取时为登记的epoch，否则为0
+        atomic<bool> in_use_;
+        Record *next_;
+        size_t id_;               // 领取顺序，从0开始连续编号，复用时不变
+
+        explicit Record(size_t id) : epoch_(0), in_use_(true), next_(NULL), id_(id) {}
+    };
+
+    // 读取期间持有，析构前读到的对象不会被释放。不能嵌套
+    class Guard
+    {
+        Record &record_;
+
+        Guard(const Guard &);
+        Guard &operator=(const Guard &);
+
+    public:
+        Guard(EpochDomain &domain, Record &record) : record_(record)
+        {
+            // 登记与之后的读取都是seq_cst，advance()要么看到这次登记，要么这次读取看到写入方摘下对象后的状态
+            record_.epoch_.store(domain.epoch_.load(memory_order_seq_cst), memory_order_seq_cst);
+        }
+
+        ~Guard() { record_.epoch_.store(0, memory_order_release); }
+    };
+
+private:
+    atomic<uint64_t> epoch_;
+    atomic<Record *> records_;
+    atomic<size_t> count_;
+
+    // 线程退出时交还记录
+    struct Owner
+    {
+        Record *record_;
+        ~Owner()
+        {
+            if (record_ != NULL)
+                record_->in_use_.store(false, memory_order_release);
+        }
+    };
+
+    EpochDomain() : epoch_(1), records_(NULL), count_(0) {}
+
+    Record *acquire()
+    {
+        for (Record *r = records_.load(memory_order_acquire); r != NULL; r = r->next_)
+        {
+            bool expected = false;
+            if (!r->in_use_.load(memory_order_relaxed) && r->in_use_.compare_exchange_strong(expected, true, memory_order_acq_rel))
+                return r;
+        }
+        Record *r = new Record(count_.fetch_add(1, memory_order_relaxed));
+        r->next_ = records_.load(memory_order_relaxed);
+        while (!records_.compare_exchange_weak(r->next_, r, memory_order_release, memory_order_relaxed))
+            ;
+        return r;
+    }
+
+public:
+    // 不析构：退出时仍在运行的线程可能还会交还记录
+    static EpochDomain &instance()
+    {
+        static EpochDomain *domain = new EpochDomain();
+        return *domain;
+    }
+
+    // 当前线程的记录
+    Record &local()
+    {
+        static thread_local Owner owner = {NULL};
+        if (owner.record_ == NULL)
+            owner.record_ = acquire();
+        return *owner.record_;
+    }
+
+    // 写入方摘下对象后读取，作为对象的标记
+    uint64_t current() const { return epoch_.load(memory_order_seq_cst); }
+
+    // 推进全局epoch，返回正在读取的线程登记的最小epoch，没有正在读取的线程时返回UINT64_MAX。
+    // 调用前标记的对象中，标记小于返回值的可以释放
+    uint64_t advance()
+    {
+        epoch_.fetch_add(1, memory_order_seq_cst);
+        uint64_t oldest = UINT64_MAX;
+        for (Record *r = records_.load(memory_order_acquire); r != NULL; r = r->next_)
+        {
+            uint64_t e = r->epoch_.load(memory_order_seq_cst);
+            if (e != 0 && e < oldest)
+                oldest = e;
+        }
+        return oldest;
+    }
+};
+
+// 读路径不加锁的LRU-K缓存（需要C++17）。
+// 每个分片把数据和淘汰策略分开：
+//   index_  : 读索引，开放寻址的hash表，槽位是指向不可变节点的原子指针。get在EpochDomain::Guard内查找并拷贝值，
+//             不加锁、不修改引用计数，除本线程的epoch记录和读缓冲区外不写任何数据；
+//   policy_ : 只有key的LRUK_Cache，负责访问时间记录和淘汰顺序，由policy_lock_独占保护。
+// get命中后不直接修改policy_，而是把key写入本线程对应的无锁读缓冲区，每写入READ_BUFFER_DRAIN条尝试获取
+// policy_lock_批量回放；缓冲区满时直接丢弃这次访问记录，读路径不分配内存，也永远不会等待淘汰策略的锁。
+// 所有修改都持有policy_lock_，index_只有一个写入方。为避免index_与policy_不一致，不支持ghost模式
+template <typename KEY, typename VALUE, size_t K = 0, typename CLOCK = LogicalClock>
+class ConcurrentLRUK_Cache
+{
+    static const size_t READ_BUFFER_STRIPES = 16;  // 每个分片的读缓冲区个数，线程按EpochDomain记录的编号分配
+    static const size_t READ_BUFFER_SIZE = 64;     // 每个读缓冲区的槽位数，需为2的幂
+    static const size_t READ_BUFFER_DRAIN = 32;    // 每写入多少条访问记录尝试回放一次
+
+    // 多写一读的定长环形缓冲区：写入方用CAS占用槽位，不加锁；只有持有policy_lock_的线程读取。
+    // 槽位的seq_等于pos时位置pos可写入，等于pos+1时已写入可读取，读取后设为pos+READ_BUFFER_SIZE供下一轮写入。
+    // 按缓存行对齐，不同线程写入的缓冲区不会互相干扰
+    struct alignas(64) ReadBuffer
+    {
+        struct Slot
+        {
+            atomic<size_t> seq_;
+            KEY key_;
+        };
+
+        atomic<size_t> tail_;  // 下一个写入位置
+        size_t head_;          // 下一个读取位置，由policy_lock_保护
+        Slot slots_[READ_BUFFER_SIZE];
+
+        ReadBuffer() : tail_(0), head_(0)
+        {
+            for (size_t i = 0; i < READ_BUFFER_SIZE; i++)
+                slots_[i].seq_.store(i, memory_order_relaxed);
+        }
+
+        // 写入k，pos为写入的位置；缓冲区满时不写入，返回false
+        bool push(const KEY &k, size_t &pos)
+        {
+            pos = tail_.load(memory_order_relaxed);
+            while (true)
+            {
+                Slot &slot = slots_[pos & (READ_BUFFER_SIZE - 1)];
+                intptr_t diff = static_cast<intptr_t>(slot.seq_.load(memory_order_acquire) - pos);
+                if (diff == 0)
+                {
+                    if (tail_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                    {
+                        slot.key_ = k;
+                        slot.seq_.store(pos + 1, memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                    return false;
+                else
+                    pos = tail_.load(memory_order_relaxed);
+            }
+        }
+
+        // 把已写入的key依次移到keys中，最多READ_BUFFER_SIZE个，遇到尚未写完的槽位时停止，返回个数。需持有policy_lock_
+        size_t drain(KEY *keys)
+        {
+            size_t n = 0;
+            for (; n < READ_BUFFER_SIZE; n++)
+            {
+                Slot &slot = slots_[head_ & (READ_BUFFER_SIZE - 1)];
+                if (slot.seq_.load(memory_order_acquire) != head_ + 1)
+                    break;
+                keys[n] = std::move(slot.key_);
+                slot.seq_.store(head_ + READ_BUFFER_SIZE, memory_order_release);
+                head_++;
+            }
+            return n;
+        }
+    };
+
+    // 分片的读索引，线性探测，负载（含已删除槽位）不超过3/4。节点写入后不再修改，覆盖时换成新节点。
+    // 读取方只在Guard内调用find；写入方持有policy_lock_，被替换、删除的节点和扩容前的旧表先挂到retired_中，
+    // 由EpochDomain确认没有读取还能访问它们之后释放
+    class ReadIndex
+    {
+    public:
+        struct Node
+        {
+            KEY key_;
+            VALUE value_;
+            size_t hash_;
+
+            template <typename... Args>
+            Node(const KEY &k, size_t h, Args&&... args) : key_(k), value_(std::forward<Args>(args)...), hash_(h) {}
+        };
+
+    private:
+        enum { MIN_CAPACITY = 16, RECLAIM_BATCH = 64 };
+
+        struct Table
+        {
+            size_t mask_;
+            unique_ptr<atomic<Node *>[]> slots_;
+
+            explicit Table(size_t capacity) : mask_(capacity - 1), slots_(new atomic<Node *>[capacity])
+            {
+                for (size_t i = 0; i < capacity; i++)
+                    slots_[i].store(NULL, memory_order_relaxed);
+            }
+        };
+
+        // 等待释放的节点或旧表，epoch_为摘下时EpochDomain::current()的值
+        struct Retired
+        {
+            uint64_t epoch_;
+            Node *node_;
+            Table *table_;
+        };
+
+        atomic<Table *> table_;
+        size_t size_;              // 以下由写入方独占：有效节点个数
+        size_t used_;              // 有效节点与已删除槽位个数之和，决定何时重建
+        vector<Retired> retired_;
+        size_t reclaim_at_;        // retired_达到这个长度时尝试释放
+
+        // 已删除的槽位，只比较地址，不解引用
+        static Node *deleted() { return reinterpret_cast<Node *>(uintptr_t(1)); }
+
+        void retire(Node *node, Table *table)
+        {
+            Retired r = {EpochDomain::instance().current(), node, table};
+            retired_.push_back(r);
+            if (retired_.size() >= reclaim_at_)
+                reclaim();
+        }
+
+        // 释放已没有读取能访问的对象。仍有读取持有时保留，下次在retired_长度翻倍后再试
+        void reclaim()
+        {
+            uint64_t oldest = EpochDomain::instance().advance();
+            size_t kept = 0;
+            for (size_t i = 0; i < retired_.size(); i++)
+            {
+                if (retired_[i].epoch_ < oldest)
+                {
+                    delete retired_[i].node_;
+                    delete retired_[i].table_;
+                }
+                else
+                    retired_[kept++] = retired_[i];
+            }
+            retired_.resize(kept);
+            reclaim_at_ = max(static_cast<size_t>(RECLAIM_BATCH), kept * 2);
+        }
+
+        // 写入方查找k所在的槽位，未找到返回NULL
+        atomic<Node *> *slotOf(const KEY &k, size_t h) const
+        {
+            Table *t = table_.load(memory_order_relaxed);
+            for (size_t i = h & t->mask_;; i = (i + 1) & t->mask_)
+            {
+                Node *p = t->slots_[i].load(memory_order_relaxed);
+                if (p == NULL)
+                    return NULL;
+                if (p != deleted() && p->hash_ == h && p->key_ == k)
+                    return &t->slots_[i];
+            }
+        }
+
+        // 按当前节点个数重建，清除已删除的槽位。节点本身不复制，新表发布后旧表留给仍在读取的线程
+        void rebuild()
+        {
+            Table *old = table_.load(memory_order_relaxed);
+            size_t capacity = MIN_CAPACITY;
+            while (capacity < (size_ + 1) * 2)
+                capacity *= 2;
+            Table *t = new Table(capacity);
+            for (size_t i = 0; i <= old->mask_; i++)
+            {
+                Node *p = old->slots_[i].load(memory_order_relaxed);
+                if (p == NULL || p == deleted())
+                    continue;
+                size_t j = p->hash_ & t->mask_;
+                while (t->slots_[j].load(memory_order_relaxed) != NULL)
+                    j = (j + 1) & t->mask_;
+                t->slots_[j].store(p, memory_order_relaxed);
+            }
+            used_ = size_;
+            table_.store(t, memory_order_seq_cst);
+            retire(NULL, old);
+        }
+
+    public:
+        ReadIndex() : table_(new Table(MIN_CAPACITY)), size_(0), used_(0), reclaim_at_(RECLAIM_BATCH) {}
+
+        // 析构时不能再有读取
+        ~ReadIndex()
+        {
+            Table *t = table_.load(memory_order_relaxed);
+            for (size_t i = 0; i <= t->mask_; i++)
+            {
+                Node *p = t->slots_[i].load(memory_order_relaxed);
+                if (p != NULL && p != deleted())
+                    delete p;
+            }
+            delete t;
+            for (size_t i = 0; i < retired_.size(); i++)
+            {
+                delete retired_[i].node_;
+                delete retired_[i].table_;
+            }
+        }
+
+        // 不加锁查找，需在EpochDomain::Guard内调用，返回的节点在Guard析构前有效
+        const Node *find(const KEY &k, size_t h) const
+        {
+            const Table *t = table_.load(memory_order_seq_cst);
+            for (size_t i = h & t->mask_;; i = (i + 1) & t->mask_)
+            {
+                const Node *p = t->slots_[i].load(memory_order_seq_cst);
+                if (p == NULL)
+                    return NULL;
+                if (p != deleted() && p->hash_ == h && p->key_ == k)
+                    return p;
+            }
+        }
+
+        // 写入节点，已有相同key的节点时替换
+        void assign(Node *node)
+        {
+            atomic<Node *> *slot = slotOf(node->key_, node->hash_);
+            if (slot != NULL)
+            {
+                Node *old = slot->load(memory_order_relaxed);
+                slot->store(node, memory_order_seq_cst);
+                retire(old, NULL);
+                return;
+            }
+            if ((used_ + 1) * 4 > (table_.load(memory_order_relaxed)->mask_ + 1) * 3)
+                rebuild();
+            Table *t = table_.load(memory_order_relaxed);
+            size_t i = node->hash_ & t->mask_;
+            Node *p;
+            while ((p = t->slots_[i].load(memory_order_relaxed)) != NULL && p != deleted())
+                i = (i + 1) & t->mask_;
+            if (p == NULL)
+                used_++;
+            t->slots_[i].store(node, memory_order_seq_cst);
+            size_++;
+        }
+
+        bool erase(const KEY &k, size_t h)
+        {
+            atomic<Node *> *slot = slotOf(k, h);
+            if (slot == NULL)
+                return false;
+            Node *old = slot->load(memory_order_relaxed);
+            slot->store(deleted(), memory_order_seq_cst);
+            size_--;
+            retire(old, NULL);
+            return true;
+        }
+
+        // 删除所有满足pred(key)的节点，每删除一个先调用removed(key)，返回删除的个数
+        template <typename PRED, typename REMOVED>
+        size_t erase_if(PRED &pred, REMOVED removed)
+        {
+            Table *t = table_.load(memory_order_relaxed);
+            size_t erased = 0;
+            for (size_t i = 0; i <= t->mask_; i++)
+            {
+                Node *p = t->slots_[i].load(memory_order_relaxed);
+                if (p == NULL || p == deleted() || !pred(static_cast<const KEY &>(p->key_)))
+                    continue;
+                removed(p->key_);
+                t->slots_[i].store(deleted(), memory_order_seq_cst);
+                size_--;
+                erased++;
+                retire(p, NULL);
+            }
+            return erased;
+        }
+
+        void clear()
+        {
+            Table *old = table_.load(memory_order_relaxed);
+            table_.store(new Table(MIN_CAPACITY), memory_order_seq_cst);
+            size_ = used_ = 0;
+            for (size_t i = 0; i <= old->mask_; i++)
+            {
+                Node *p = old->slots_[i].load(memory_order_relaxed);
+                if (p != NULL && p != deleted())
+                    retire(p, NULL);
+            }
+            retire(NULL, old);
+        }
+    };
+
+    typedef typename ReadIndex::Node Node;
+
+    struct Shard
+    {
+        mutex policy_lock_;
+        ReadIndex index_;
+        LRUK_Cache<KEY, char, K, CLOCK> policy_;
+        vector<KEY> removed_;  // policy_淘汰的key，由policy_lock_保护，之后从index_中删除
+        ReadBuffer buffers_[READ_BUFFER_STRIPES];
+
+        Shard(int c, int k, int history_capacity, typename CLOCK::duration retained_period)
+            : policy_(c, k, history_capacity, retained_period)
+        {
+            policy_.setRemovalCallback([this](const KEY &key) { removed_.push_back(key); });
+        }
+
+        // 需持有policy_lock_
+        void applyRemovals()
+        {
+            for (size_t i = 0; i < removed_.size(); i++)
+                index_.erase(removed_[i], indexHash(hash<KEY>()(removed_[i])));
+            removed_.clear();
+        }
+
+        // 回放buffer中已写入的访问记录，同一批用getMany回放，预取索引且只读取一次时钟；
+        // 缓冲区为空时不读取时钟。需持有policy_lock_
+        void replay(ReadBuffer &buffer)
+        {
+            KEY keys[READ_BUFFER_SIZE];
+            char values[READ_BUFFER_SIZE];
+            bool found[READ_BUFFER_SIZE];
+            size_t n = buffer.drain(keys);
+            if (n == 0)
+                return;
+            policy_.getMany(keys, n, values, found);
+            applyRemovals();
+        }
+    };
+
+    vector<unique_ptr<Shard> > shards_;
+    hash<KEY> hasher_;
+
+    // 用户hash乘法打散后取高32位选择分片
+    Shard &shardFor(size_t h)
+    {
+        return *shards_[((static_cast<uint64_t>(h) * 0x9E3779B97F4A7C15ULL) >> 32) % shards_.size()];
+    }
+
+    // 读索引另做一次混合后取低位定位槽位，std::hash<int>之类的恒等hash也能均匀分布
+    static size_t indexHash(size_t h)
+    {
+        uint64_t x = h;
+        x ^= x >> 33;
+        x *= 0xFF51AFD7ED558CCDULL;
+        x ^= x >> 33;
+        return static_cast<size_t>(x);
+    }
+
+    // 记录一次命中，缓冲区满时丢弃。每写入READ_BUFFER_DRAIN条或丢弃时尝试回放，policy_正忙则留给之后的操作
+    void recordAccess(Shard &shard, size_t stripe, const KEY &k)
+    {
+        ReadBuffer &buffer = shard.buffers_[stripe % READ_BUFFER_STRIPES];
+        size_t pos;
+        if (buffer.push(k, pos) && (pos + 1) % READ_BUFFER_DRAIN != 0)
+            return;
+        unique_lock<mutex> policy_guard(shard.policy_lock_, try_to_lock);
+        if (policy_guard.owns_lock())
+            shard.replay(buffer);
+    }
+
+    // 写操作前先回放所有读缓冲区，使写入看到的访问顺序尽量准确。需持有policy_lock_
+    void drainBuffers(Shard &shard)
+    {
+        for (size_t i = 0; i < READ_BUFFER_STRIPES; i++)
+            shard.replay(shard.buffers_[i]);
+    }
+
+    void init(int shards, int c, int k, int history_capacity, typename CLOCK::duration retained_period)
+    {
+        assert(shards > 0);
+        int shard_capacity = (c + shards - 1) / shards;
+        int shard_history_capacity = (history_capacity + shards - 1) / shards;
+        for (int i = 0; i < shards; i++)
+            shards_.push_back(unique_ptr<Shard>(new Shard(shard_capacity, k, shard_history_capacity, retained_period)));
+    }
+
+public:
+    ConcurrentLRUK_Cache(int shards, int c, int k)
+    {
+        init(shards, c, k, c, typename CLOCK::duration());
+    }
+
+    ConcurrentLRUK_Cache(int shards, int c, int k, int history_capacity, typename CLOCK::duration retained_period)
+    {
+        init(shards, c, k, history_capacity, retained_period);
+    }
+
+    // 命中时拷贝出值并记录一次访问，查找和拷贝都不加锁
+    VALUE get(const KEY &k, bool &found)
+    {
+        size_t h = hasher_(k);
+        Shard &shard = shardFor(h);
+        EpochDomain &domain = EpochDomain::instance();
+        EpochDomain::Record &self = domain.local();
+        VALUE ret = VALUE();
+        {
+            EpochDomain::Guard guard(domain, self);
+            const Node *node = shard.index_.find(k, indexHash(h));
+            found = node != NULL;
+            if (!found)
+                return ret;
+            ret = node->value_;
+        }
+        recordAccess(shard, self.id_, k);
+        return ret;
+    }
+
+    // 与get相同但不记录访问，不会写入读缓冲区
+    VALUE peek(const KEY &k, bool &found)
+    {
+        size_t h = hasher_(k);
+        Shard &shard = shardFor(h);
+        EpochDomain &domain = EpochDomain::instance();
+        EpochDomain::Guard guard(domain, domain.local());
+        const Node *node = shard.index_.find(k, indexHash(h));
+        found = node != NULL;
+        return found ? node->value_ : VALUE();
+    }
+
+    bool contains(const KEY &k)
+    {
+        size_t h = hasher_(k);
+        Shard &shard = shardFor(h);
+        EpochDomain &domain = EpochDomain::instance();
+        EpochDomain::Guard guard(domain, domain.local());
+        return shard.index_.find(k, indexHash(h)) != NULL;
+    }
+
+    void put(const KEY &k, const VALUE &v)
+    {
+        emplace(k, v);
+    }
+
+    void put(const KEY &k, VALUE &&v)
+    {
+        emplace(k, std::move(v));
+    }
+
+    // 在锁外构造新节点，写入后旧节点在没有读取持有时释放
+    template <typename... Args>
+    void emplace(const KEY &k, Args&&... args)
+    {
+        size_t h = hasher_(k);
+        Node *node = new Node(k, indexHash(h), std::forward<Args>(args)...);
+        Shard &shard = shardFor(h);
+        lock_guard<mutex> policy_guard(shard.policy_lock_);
+        drainBuffers(shard);
+        shard.policy_.put(k, char());
+        shard.applyRemovals();
+        shard.index_.assign(node);
+    }
+
+    // 总容量均分到各分片。缩容在policy_的后续操作（写入和读缓冲区回放）中逐步完成，
+    // 被淘汰的key随之从index_中删除
+    void setCapacity(int c)
+    {
+        int n = static_cast<int>(shards_.size());
+        for (int i = 0; i < n; i++)
+        {
+            lock_guard<mutex> policy_guard(shards_[i]->policy_lock_);
+            shards_[i]->policy_.setCapacity((c + n - 1) / n);
+        }
+    }
+
+    void setHistoryCapacity(int history_capacity)
+    {
+        int n = static_cast<int>(shards_.size());
+        for (int i = 0; i < n; i++)
+        {
+            lock_guard<mutex> policy_guard(shards_[i]->policy_lock_);
+            shards_[i]->policy_.setHistoryCapacity((history_capacity + n - 1) / n);
+        }
+    }
+
+    // 删除k，返回k是否存在。读缓冲区中k的访问记录之后回放时找不到k，直接忽略
+    bool erase(const KEY &k)
+    {
+        size_t h = hasher_(k);
+        Shard &shard = shardFor(h);
+        lock_guard<mutex> policy_guard(shard.policy_lock_);
+        shard.policy_.erase(k);
+        return shard.index_.erase(k, indexHash(h));
+    }
+
+    // 依次在各分片内删除满足pred(key)的数据，返回删除的个数。遍历期间持有分片的policy_lock_，读取不受影响
+    template <typename PRED>
+    size_t erase_if(PRED pred)
+    {
+        size_t erased = 0;
+        for (size_t i = 0; i < shards_.size(); i++)
+        {
+            Shard &shard = *shards_[i];
+            lock_guard<mutex> policy_guard(shard.policy_lock_);
+            erased += shard.index_.erase_if(pred, [&shard](const KEY &k) { shard.policy_.erase(k); });
+        }
+        return erased;
+    }
+
+    size_t erase_range(const KEY &first, const KEY &last)
+    {
+        return erase_if([&](const KEY &k) { return !(k < first) && k < last; });
+    }
+
+    size_t erase_prefix(const KEY &prefix)
+    {
+        return erase_if([&](const KEY &k) { return k.compare(0, prefix.size(), prefix) == 0; });
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < shards_.size(); i++)
+        {
+            Shard &shard = *shards_[i];
+            lock_guard<mutex> policy_guard(shard.policy_lock_);
+            // 正在写入的记录之后回放时找不到key，直接忽略
+            KEY keys[READ_BUFFER_SIZE];
+            for (size_t j = 0; j < READ_BUFFER_STRIPES; j++)
+                shard.buffers_[j].drain(keys);
+            shard.policy_.clear();
+            shard.removed_.clear();
+            shard.index_.clear();
+        }
+    }
+};
+#endif
+
+#if defined(__cpp_impl_coroutine) && __cplusplus >= 202002L
+// 协程任务：创建后不立即执行，被co_await时才开始，结束后恢复等待它的协程
+class TaskPromiseBase
+{
+public:
+    coroutine_handle<> continuation_;  // co_await该任务的协程
+    exception_ptr error_;
+
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+
+        template <typename PROMISE>
+        coroutine_handle<> await_suspend(coroutine_handle<PROMISE> h) noexcept
+        {
+            coroutine_handle<> continuation = h.promise().continuation_;
+            return continuation ? continuation : noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    suspend_always initial_suspend() noexcept { return suspend_always(); }
+    FinalAwaiter final_suspend() noexcept { return FinalAwaiter(); }
+    void unhandled_exception() { error_ = current_exception(); }
+};
+
+template <typename T>
+class Task
+{
+public:
+    struct promise_type : TaskPromiseBase
+    {
+        optional<T> value_;
+
+        Task get_return_object() { return Task(coroutine_handle<promise_type>::from_promise(*this)); }
+
+        template <typename U>
+        void return_value(U &&v) { value_.emplace(std::forward<U>(v)); }
+    };
+
+    explicit Task(coroutine_handle<promise_type> h) : handle_(h) {}
+    Task(Task &&other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task()
+    {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting)
+    {
+        handle_.promise().continuation_ = awaiting;
+        return handle_;
+    }
+
+    T await_resume()
+    {
+        if (handle_.promise().error_)
+            rethrow_exception(handle_.promise().error_);
+        return std::move(*handle_.promise().value_);
+    }
+
+private:
+    coroutine_handle<promise_type> handle_;
+};
+
+template <>
+class Task<void>
+{
+public:
+    struct promise_type : TaskPromiseBase
+    {
+        Task get_return_object() { return Task(coroutine_handle<promise_type>::from_promise(*this)); }
+        void return_void() {}
+    };
+
+    explicit Task(coroutine_handle<promise_type> h) : handle_(h) {}
+    Task(Task &&other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task()
+    {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting)
+    {
+        handle_.promise().continuation_ = awaiting;
+        return handle_;
+    }
+
+    void await_resume()
+    {
+        if (handle_.promise().error_)
+            rethrow_exception(handle_.promise().error_);
+    }
+
+    coroutine_handle<promise_type> handle() const { return handle_; }
+    bool done() const { return !handle_ || handle_.done(); }
+
+private:
+    coroutine_handle<promise_type> handle_;
+};
+
+// 单线程执行器：就绪的协程通过post排队，run()在调用线程上依次恢复，直到没有就绪的协程。
+// 主要用于测试和单线程事件循环，所有协程及其访问的缓存都只在run()所在的线程上运行
+class SingleThreadExecutor
+{
+    deque<coroutine_handle<> > ready_;
+    list<Task<void> > spawned_;  // spawn启动的顶层任务，结束后由run()回收
+
+public:
+    struct YieldAwaiter
+    {
+        SingleThreadExecutor *executor_;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> h) { executor_->post(h); }
+        void await_resume() const noexcept {}
+    };
+
+    void post(coroutine_handle<> h) { ready_.push_back(h); }
+
+    // 启动顶层任务，任务中未捕获的异常被丢弃
+    void spawn(Task<void> task)
+    {
+        post(task.handle());
+        spawned_.push_back(std::move(task));
+    }
+
+    // co_await executor.yield() 让出执行权，排到就绪队列末尾，可用于模拟异步I/O
+    YieldAwaiter yield() { return YieldAwaiter{this}; }
+
+    // 恢复就绪的协程直到队列为空，返回恢复的次数
+    size_t run()
+    {
+        size_t resumed = 0;
+        while (!ready_.empty())
+        {
+            coroutine_handle<> h = ready_.front();
+            ready_.pop_front();
+            h.resume();
+            resumed++;
+        }
+        for (list<Task<void> >::iterator it = spawned_.begin(); it != spawned_.end();)
+        {
+            if (it->done())
+                it = spawned_.erase(it);
+            else
+                ++it;
+        }
+        return resumed;
+    }
+};
+
+// 基于协程的读穿透缓存：async_get未命中时挂起，由加载协程填充数据，同一key的其他请求挂起等待，
+// 加载完成后通过执行器恢复所有等待者，期间执行器线程可以继续处理其他协程，不会阻塞。
+// 不加锁，所有调用都必须在同一个执行器线程上进行
+template <typename KEY, typename VALUE, size_t K = 0, typename CLOCK = LogicalClock>
+class AsyncLRUK_Cache
+{
+    // 一次正在进行的加载
+    struct Flight
+    {
+        bool done_;
+        bool invalidated_;  // 加载期间key被erase，加载结果不写入缓存
+        VALUE value_;
+        exception_ptr error_;
+        vector<coroutine_handle<> > waiters_;
+
+        Flight() : done_(false), invalidated_(false) {}
+    };
+
+    struct FlightAwaiter
+    {
+        Flight *flight_;  // 由等待协程的参数持有，不在co_await的临时对象中持有shared_ptr
+
+        bool await_ready() const noexcept { return flight_->done_; }
+        void await_suspend(coroutine_handle<> h) { flight_->waiters_.push_back(h); }
+        void await_resume() const noexcept {}
+    };
+
+    SingleThreadExecutor &executor_;
+    LRUK_Cache<KEY, VALUE, K, CLOCK> cache_;
+    unordered_map<KEY, shared_ptr<Flight> > flights_;  // 正在加载的key
+    LoadStats stats_;
+
+    // 等待flight完成，返回其结果或重新抛出其异常
+    static Task<VALUE> waitFor(shared_ptr<Flight> flight)
+    {
+        co_await FlightAwaiter{flight.get()};
+        if (flight->error_)
+            rethrow_exception(flight->error_);
+        co_return flight->value_;
+    }
+
+    // async_get未命中时：等待k正在进行的加载，没有则开始加载
+    template <typename LOADER>
+    Task<VALUE> miss(KEY k, LOADER loader)
+    {
+        typename unordered_map<KEY, shared_ptr<Flight> >::iterator it = flights_.find(k);
+        if (it != flights_.end())
+        {
+            stats_.coalesced_++;
+            co_return co_await waitFor(it->second);
+        }
+        shared_ptr<Flight> flight = make_shared<Flight>();
+        flights_.emplace(k, flight);
+        stats_.loads_++;
+        co_return co_await load(k, loader, flight);
+    }
+
+    // 作为k的唯一加载者运行loader，完成后将等待者交给执行器恢复
+    template <typename LOADER>
+    Task<VALUE> load(KEY k, LOADER loader, shared_ptr<Flight> flight)
+    {
+        try
+        {
+            flight->value_ = co_await loader(k);
+            if (!flight->invalidated_)
+                cache_.try_emplace(k, flight->value_);
+        }
+        catch (...)
+        {
+            stats_.failures_++;
+            flight->error_ = current_exception();
+        }
+        flight->done_ = true;
+        flights_.erase(k);
+        // 等待者由执行器恢复，不在加载协程中递归恢复
+        for (size_t i = 0; i < flight->waiters_.size(); i++)
+            executor_.post(flight->waiters_[i]);
+        if (flight->error_)
+            rethrow_exception(flight->error_);
+        co_return flight->value_;
+    }
+
+public:
+    AsyncLRUK_Cache(SingleThreadExecutor &executor, int c, int k) : executor_(executor), cache_(c, k) {}
+
+    AsyncLRUK_Cache(SingleThreadExecutor &executor, int c, int k, int history_capacity, typename CLOCK::duration retained_period,
+                    bool ghost_history = false, int staging_capacity = 0)
+        : executor_(executor), cache_(c, k, history_capacity, retained_period, ghost_history, staging_capacity) {}
+
+    // async_get的返回值，只能co_await一次。命中时持有值，await_ready为true，co_await既不挂起也不创建协程帧，
+    // 一个协程连续命中任意多次都不会加深调用栈；未命中时持有尚未开始的miss协程，co_await时开始
+    class GetAwaiter
+    {
+        optional<VALUE> value_;
+        optional<Task<VALUE> > task_;
+
+    public:
+        explicit GetAwaiter(const VALUE &v) : value_(v) {}
+        explicit GetAwaiter(Task<VALUE> &&task) : task_(std::move(task)) {}
+
+        bool await_ready() const noexcept { return value_.has_value() || task_->await_ready(); }
+        coroutine_handle<> await_suspend(coroutine_handle<> awaiting) { return task_->await_suspend(awaiting); }
+        VALUE await_resume() { return value_ ? std::move(*value_) : task_->await_resume(); }
+    };
+
+    // 命中时直接返回值，查找在调用async_get时进行；未命中时co_await loader(k)（返回Task<VALUE>的协程）加载并写入缓存。
+    // 同一key同时只有一个加载协程，其他请求等待其结果或其抛出的异常。
+    // 加载期间其他协程put的值优先保留，不会被加载结果覆盖
+    template <typename LOADER>
+    GetAwaiter async_get(KEY k, LOADER loader)
+    {
+        const VALUE *v = cache_.get(k);
+        if (v != NULL)
+        {
+            stats_.hits_++;
+            return GetAwaiter(*v);
+        }
+        return GetAwaiter(miss(std::move(k), std::move(loader)));
+    }
+
+    // 删除k，返回k是否存在。k正在加载时，加载结果只返回给等待者，不再写入缓存
+    bool erase(const KEY &k)
+    {
+        typename unordered_map<KEY, shared_ptr<Flight> >::iterator it = flights_.find(k);
+        if (it != flights_.end())
+            it->second->invalidated_ = true;
+        return cache_.erase(k);
+    }
+
+    // 同步访问底层缓存，如直接put
+    LRUK_Cache<KEY, VALUE, K, CLOCK> &cache() { return cache_; }
+
+    LoadStats loadStats() const { return stats_; }
+};
+#endif
+
+// ==================== 自检与性能测试 ====================
+// main()在演示之后运行runSelfChecks()，自检只使用assert，没有输出；
+// 以bench参数运行时（如./LRU-K bench）只运行runBenchmarks()并输出各项结果，不运行演示
+
+// 按LRU-K的定义直接实现的参考模型，结果应与LRUK_Cache(c, k)相同：每条记录保存最近k次访问时间，
+// 淘汰时线性查找倒数第k次访问最早的数据，从cacheList淘汰的数据回到historyList头部，之后修剪historyList。
+// 只用于与LRUK_Cache对比，不考虑效率
+template <typename KEY, typename VALUE>
+class ReferenceLRUK
+{
+    struct Entry
+    {
+        KEY key_;
+        VALUE value_;
+        deque<uint64_t> access_time_;  // 最近k次访问时间，越早越靠前
+    };
+
+    size_t capacity_;
+    size_t k_;
+    uint64_t now_;                     // 与LogicalClock相同，每次get/put加一
+    list<Entry> historyList_;          // 头部为最近访问的记录
+    list<Entry> cacheList_;
+
+    static typename list<Entry>::iterator find(list<Entry> &l, const KEY &k)
+    {
+        typename list<Entry>::iterator it = l.begin();
+        while (it != l.end() && !(it->key_ == k))
+            it++;
+        return it;
+    }
+
+    void record(Entry &e)
+    {
+        e.access_time_.push_back(now_);
+        if (e.access_time_.size() > k_)
+            e.access_time_.pop_front();
+    }
+
+    // 记录一次对k的访问，达到k次的历史记录晋升，返回k的记录，不存在时返回NULL
+    Entry *access(const KEY &k)
+    {
+        now_++;
+        typename list<Entry>::iterator it = find(cacheList_, k);
+        if (it != cacheList_.end())
+        {
+            record(*it);
+            return &*it;
+        }
+        it = find(historyList_, k);
+        if (it == historyList_.end())
+            return NULL;
+        record(*it);
+        if (it->access_time_.size() < k_)
+        {
+            historyList_.splice(historyList_.begin(), historyList_, it);
+            return &historyList_.front();
+        }
+        cacheList_.splice(cacheList_.begin(), historyList_, it);
+        if (cacheList_.size() > capacity_)
+        {
+            typename list<Entry>::iterator vict = ++cacheList_.begin();
+            for (typename list<Entry>::iterator c = vict; c != cacheList_.end(); c++)
+            {
+                if (c->access_time_.front() < vict->access_time_.front())
+                    vict = c;
+            }
+            historyList_.splice(historyList_.begin(), cacheList_, vict);
+        }
+        while (historyList_.size() > capacity_)
+            historyList_.pop_back();
+        return &cacheList_.front();
+    }
+
+public:
+    ReferenceLRUK(int c, int k) : capacity_(c), k_(k), now_(0) {}
+
+    VALUE get(const KEY &k, bool &found)
+    {
+        Entry *e = access(k);
+        found = e != NULL;
+        return found ? e->value_ : VALUE();
+    }
+
+    void put(const KEY &k, const VALUE &v)
+    {
+        Entry *e = access(k);
+        if (e != NULL)
+        {
+            e->value_ = v;
+            return;
+        }
+        if (historyList_.size() >= capacity_)
+            historyList_.pop_back();
+        Entry entry = {k, v, deque<uint64_t>(1, now_)};
+        historyList_.push_front(entry);
+    }
+
+    // 删除满足pred(key)的记录，不计为访问
+    template <typename PRED>
+    size_t erase_if(PRED pred)
+    {
+        size_t erased = 0;
+        list<Entry> *lists[2] = {&cacheList_, &historyList_};
+        for (int i = 0; i < 2; i++)
+        {
+            for (typename list<Entry>::iterator it = lists[i]->begin(); it != lists[i]->end();)
+            {
+                if (pred(it->key_))
+                {
+                    it = lists[i]->erase(it);
+                    erased++;
+                }
+                else
+                    it++;
+            }
+        }
+        return erased;
+    }
+};
+
+// 对actual和参考模型执行同一个随机get/put序列(key在[0, keys)中)，每次get的结果都应相同
+template <typename CACHE>
+void compareWithReference(CACHE &actual, int c, int k, int keys, unsigned seed)
+{
+    ReferenceLRUK<int, int> expected(c, k);
+    unsigned x = seed;
+    for (int i = 0; i < 4000; i++)
+    {
+        x = x * 1664525u + 1013904223u;
+        int key = static_cast<int>((x >> 10) % keys);
+        if ((x >> 5) & 1)
+        {
+            bool found_expected, found_actual;
+            int v_expected = expected.get(key, found_expected);
+            int v_actual = actual.get(key, found_actual);
+            assert(found_expected == found_actual && v_expected == v_actual);
+            (void)v_expected;
+            (void)v_actual;
+        }
+        else
+        {
+            expected.put(key, i);
+            actual.put(key, i);
+        }
+    }
+}
+
+// LRUK_Cache与参考模型对比，运行期K和编译期K各一组，并检查内部结构
+void checkAgainstReference()
+{
+    for (int k = 1; k <= 4; k++)
+    {
+        for (int c = 1; c <= 8; c++)
+        {
+            LRUK_Cache<int, int> cache(c, k);
+            compareWithReference(cache, c, k, c * 3, k * 100 + c);
+            cache.checkInvariants();
+        }
+    }
+    for (int c = 1; c <= 8; c++)
+    {
+        LRUK_Cache<int, int, 2> cache2(c);
+        compareWithReference(cache2, c, 2, c * 3, c);
+        LRUK_Cache<int, int, 7> cache7(c);
+        compareWithReference(cache7, c, 7, c * 3, c);
+    }
+}
+
+// checkFlatIndex使用：槽位中直接保存key
+struct IdentityKeyOf
+{
+    const int &operator()(const int &k) const { return k; }
+};
+
+// 所有key的hash相同，探测链覆盖全部元素并跨越数组末尾，tag全部相同
+struct ConstantHash
+{
+    size_t operator()(int) const { return 12345; }
+};
+
+// FlatIndex与vector<bool>对比随机插入、删除和查找，key的范围小，删除标记和原容量重建频繁出现
+template <typename HASH>
+void checkFlatIndexWith(int keys, unsigned seed)
+{
+    FlatIndex<int, int, IdentityKeyOf, HASH> index;
+    vector<bool> present(keys, false);
+    unsigned x = seed;
+    for (int i = 0; i < 200000; i++)
+    {
+        x = x * 1664525u + 1013904223u;
+        int key = static_cast<int>((x >> 10) % keys);
+        int op = (x >> 5) % 3;
+        if (op == 0 && !present[key])
+        {
+            index.insert(key, key);
+            present[key] = true;
+        }
+        else if (op == 1)
+        {
+            bool erased = index.erase(key);
+            assert(erased == present[key]);
+            present[key] = false;
+            (void)erased;
+        }
+        else
+        {
+            const int *found = index.find(key, index.hashOf(key));
+            assert((found != NULL) == present[key] && (found == NULL || *found == key));
+            (void)found;
+        }
+        if (i % 10000 == 0)
+        {
+            size_t n = 0;
+            for (int k = 0; k < keys; k++)
+            {
+                assert((index.find(k) != NULL) == present[k]);
+                n += present[k];
+            }
+            assert(index.size() == n);
+            (void)n;
+        }
+    }
+}
+
+void checkFlatIndex()
+{
+    checkFlatIndexWith<hash<int> >(50, 1);
+    checkFlatIndexWith<hash<int> >(5000, 2);
+    checkFlatIndexWith<ConstantHash>(100, 3);
+}
+
+// 随机操作中每一步之后检查内部结构，覆盖ghost模式、单独的历史容量和保留时长
+void checkInvariantsUnderRandomOps()
+{
+    for (int ghost = 0; ghost < 2; ghost++)
+    {
+        for (int k = 1; k <= 3; k++)
+        {
+            LRUK_Cache<int, int> cache(6, k, 10, LogicalClock::duration(ghost ? 0 : 15), ghost != 0, ghost ? 4 : 0);
+            unsigned x = k + ghost * 10;
+            for (int i = 0; i < 3000; i++)
+            {
+                x = x * 1664525u + 1013904223u;
+                int key = static_cast<int>((x >> 10) % 30);
+                if ((x >> 5) & 1)
+                {
+                    const int *v = cache.get(key);
+                    assert(v == NULL || *v == key);
+                    (void)v;
+                }
+                else
+                    cache.put(key, key);
+                cache.checkInvariants();
+            }
+        }
+    }
+}
+
+// erase系列与参考模型对比：只删除对应的记录，其余数据的淘汰顺序不受影响；string key按前缀删除
+void checkErase()
+{
+    for (int k = 1; k <= 3; k++)
+    {
+        LRUK_Cache<int, int> actual(8, k);
+        ReferenceLRUK<int, int> expected(8, k);
+        unsigned x = k;
+        for (int i = 0; i < 4000; i++)
+        {
+            x = x * 1664525u + 1013904223u;
+            int key = static_cast<int>((x >> 10) % 24);
+            int op = (x >> 5) % 8;
+            if (op == 0)
+            {
+                bool erased = actual.erase(key);
+                assert(erased == (expected.erase_if([key](const int &e) { return e == key; }) == 1));
+                (void)erased;
+            }
+            else if (op == 1)
+            {
+                size_t erased = actual.erase_range(key, key + 3);
+                assert(erased == expected.erase_if([key](const int &e) { return e >= key && e < key + 3; }));
+                (void)erased;
+            }
+            else if (op < 5)
+            {
+                bool found_expected, found_actual;
+                int v_expected = expected.get(key, found_expected);
+                int v_actual = actual.get(key, found_actual);
+                assert(found_expected == found_actual && v_expected == v_actual);
+                (void)v_expected;
+                (void)v_actual;
+            }
+            else
+            {
+                expected.put(key, i);
+                actual.put(key, i);
+            }
+            actual.checkInvariants();
+        }
+    }
+
+    ShardedLRUK_Cache<string, int> strings(4, 64, 1);
+    for (int i = 0; i < 20; i++)
+        strings.put((i % 2 ? "user:" : "item:") + to_string(i), i);
+    assert(strings.erase_prefix("user:") == 10 && !strings.contains("user:1") && strings.contains("item:0"));
+    assert(strings.erase("item:0") && !strings.erase("item:0") && strings.contains("item:2"));
+}
+
+// 存活时间：写入ttl个刻度后过期，get不会延长，重新写入时重新计时；跨越时间轮多层的到期时间与逐条计算的结果相同；
+// 到期与淘汰混合时内部结构保持一致，get不会返回已到期的值，监听者收到的EXPIRED都已到期
+void checkTTL()
+{
+    typedef LogicalClock::duration ticks;
+    LRUK_Cache<int, int> cache(8, 2);
+    cache.put(1, 1, ticks(5));  // 第1次访问写入，第6次访问开始时过期
+    cache.setDefaultTTL(ticks(3));
+    cache.put(2, 2);
+    assert(cache.get(1) != NULL);
+    cache.put(2, 2);
+    assert(cache.get(2) != NULL && cache.get(1) == NULL && cache.removeExpired() == 1 && !cache.contains(2));
+    cache.setDefaultTTL(ticks());
+    cache.put(3, 3);
+    for (int i = 0; i < 100; i++)
+        cache.removeExpired();
+    assert(cache.contains(3));
+
+    // deadlines为按到期时间排序的小根堆，已被重新写入或到期的项在出堆时跳过
+    LRUK_Cache<int, int> wheel(4096, 1);
+    vector<uint64_t> deadline(2000, 0);
+    vector<pair<uint64_t, int> > deadlines;
+    uint64_t now = 0;
+    unsigned x = 7;
+    for (int i = 0; i < 400000; i++)
+    {
+        x = x * 1664525u + 1013904223u;
+        int key = static_cast<int>((x >> 10) % deadline.size());
+        now++;
+        size_t expired = 0;
+        while (!deadlines.empty() && deadlines.front().first <= now)
+        {
+            if (deadline[deadlines.front().second] == deadlines.front().first)
+            {
+                deadline[deadlines.front().second] = 0;
+                expired++;
+            }
+            pop_heap(deadlines.begin(), deadlines.end(), greater<pair<uint64_t, int> >());
+            deadlines.pop_back();
+        }
+        if ((x >> 5) % 8 == 0)
+        {
+            // 存活时间在2^0到2^18之间按指数均匀分布，覆盖时间轮的前四层
+            uint64_t ttl = 1 + (((x * 2654435761u) >> 8) & ((1u << ((x >> 6) % 19)) - 1));
+            wheel.put(key, key, ticks(ttl));
+            deadline[key] = now + ttl;
+            deadlines.push_back(make_pair(deadline[key], key));
+            push_heap(deadlines.begin(), deadlines.end(), greater<pair<uint64_t, int> >());
+        }
+        else
+        {
+            size_t removed = wheel.removeExpired();
+            assert(removed == expired);
+            (void)removed;
+        }
+        assert(wheel.contains(key) == (deadline[key] != 0));
+    }
+    wheel.checkInvariants();
+    (void)now;
+
+    // 历史记录超过保留时长时同样以EXPIRED通知，只在不保留时检查监听者
+    for (int retained = 0; retained <= 15; retained += 15)
+    {
+        for (int k = 1; k <= 3; k++)
+        {
+            LRUK_Cache<int, int> mixed(6, k, 10, ticks(retained));
+            uint64_t mixed_now = 0;
+            vector<uint64_t> expiry(30, 0);  // 最近一次写入时的到期时间，0表示不过期
+            mixed.setRemovalListener([&](const int &key, int &&, RemovalCause cause) {
+                assert(retained > 0 || cause != RemovalCause::EXPIRED || (expiry[key] != 0 && expiry[key] <= mixed_now));
+                (void)key;
+                (void)cause;
+            });
+            for (int i = 0; i < 3000; i++)
+            {
+                x = x * 1664525u + 1013904223u;
+                int key = static_cast<int>((x >> 10) % expiry.size());
+                int op = (x >> 5) % 4;
+                mixed_now++;
+                if (op == 0)
+                {
+                    const int *v = mixed.get(key);
+                    assert(v == NULL || (*v == key && (expiry[key] == 0 || mixed_now < expiry[key])));
+                    (void)v;
+                }
+                else if (op == 1)
+                {
+                    uint64_t ttl = (x >> 20) % 20;
+                    mixed.put(key, key, ticks(ttl));
+                    expiry[key] = ttl > 0 ? mixed_now + ttl : 0;
+                }
+                else if (op == 2)
+                {
+                    mixed.put(key, key);
+                    expiry[key] = 0;
+                }
+                else
+                    mixed.removeExpired();
+                mixed.checkInvariants();
+            }
+        }
+    }
+}
+
+// setCapacity/setHistoryCapacity：扩容立即生效；缩容时每次操作最多淘汰RESIZE_STEP条，按K距离保留最好的数据；
+// 随机调整容量时内部结构保持一致
+void checkResize()
+{
+    LRUK_Cache<int, int> cache(1000, 2);
+    for (int i = 0; i < 1000; i++)
+    {
+        cache.put(i, i);
+        cache.put(i, i);
+    }
+    cache.setCapacity(100);
+    cache.setHistoryCapacity(50);
+    assert(cache.capacity() == 100 && cache.historyCapacity() == 50 && cache.weight() == 1000);
+    int steps = 0;
+    while (cache.weight() > 100 || cache.historyWeight() > 50)
+    {
+        size_t before = cache.weight();
+        cache.removeExpired();
+        assert(before - cache.weight() <= 32 && ++steps < 100);
+        cache.checkInvariants();
+        (void)before;
+    }
+    for (int i = 900; i < 1000; i++)
+        assert(cache.peek(i) != NULL);
+    cache.setCapacity(2000);
+    for (int i = 0; i < 2000; i++)
+    {
+        cache.put(i, i);
+        cache.put(i, i);
+    }
+    assert(cache.weight() == 2000);
+
+    for (int ghost = 0; ghost < 2; ghost++)
+    {
+        for (int k = 1; k <= 3; k++)
+        {
+            LRUK_Cache<int, int> resized(6, k, 10, LogicalClock::duration(), ghost != 0, ghost ? 4 : 0);
+            unsigned x = k + ghost * 10;
+            for (int i = 0; i < 3000; i++)
+            {
+                x = x * 1664525u + 1013904223u;
+                int key = static_cast<int>((x >> 10) % 30);
+                int op = (x >> 5) % 16;
+                if (op == 0)
+                    resized.setCapacity(1 + (x >> 20) % 20);
+                else if (op == 1)
+                    resized.setHistoryCapacity((x >> 20) % 20);
+                else if (op < 9)
+                {
+                    const int *v = resized.get(key);
+                    assert(v == NULL || *v == key);
+                    (void)v;
+                }
+                else
+                    resized.put(key, key);
+                resized.checkInvariants();
+            }
+        }
+    }
+}
+
+// 移除监听者：移走丢弃的值不影响权重统计，收到的值完整
+void checkListener()
+{
+    LRUK_Cache<int, string> cache(10, 2, 1000, LogicalClock::duration());
+    cache.setWeigher([](const int &, const string &v) { return v.size(); }, 0, 100);
+    string sink;
+    int evicted = 0;
+    cache.setRemovalListener([&](const int &, string &&v, RemovalCause cause) {
+        assert(cause == RemovalCause::EVICTED && v.size() == 10);
+        sink = std::move(v);
+        evicted++;
+        (void)cause;
+    });
+    for (int i = 0; i < 50; i++)
+        cache.put(i, string(10, 'a' + i % 26));
+    assert(cache.historyWeight() == 100 && evicted == 40 && sink == string(10, 'a' + 39 % 26));
+    for (int i = 40; i < 50; i++)
+        assert(cache.peek(i) != NULL);
+    cache.checkInvariants();
+
+    // ghost模式没有暂存区：写入历史记录的值和从cacheList_淘汰的值都以EVICTED通知，不会悄悄丢弃
+    LRUK_Cache<int, string> ghost(2, 2, true, 0);
+    vector<int> dropped;
+    ghost.setRemovalListener([&](const int &k, string &&v, RemovalCause cause) {
+        assert(cause == RemovalCause::EVICTED && v == to_string(k));
+        dropped.push_back(k);
+        (void)cause;
+    }, true);
+    ghost.put(1, "1");
+    assert(dropped.size() == 1 && dropped[0] == 1);
+    for (int i = 1; i <= 3; i++)
+    {
+        ghost.put(i, to_string(i));
+        ghost.put(i, to_string(i));
+    }
+    assert(dropped.size() == 4 && dropped[1] == 2 && dropped[2] == 3 && dropped[3] == 1);
+    assert(ghost.peek(1) == NULL && ghost.peek(3) != NULL && *ghost.peek(3) == "3");
+    ghost.checkInvariants();
+}
+
+// peek/contains：穿插在随机get/put之间不改变与参考模型对比的结果；判断为已到期或超过保留时长的数据，
+// 紧接着的get同样不会返回
+void checkPeek()
+{
+    for (int k = 1; k <= 3; k++)
+    {
+        LRUK_Cache<int, int> actual(8, k);
+        ReferenceLRUK<int, int> expected(8, k);
+        unsigned x = k;
+        for (int i = 0; i < 4000; i++)
+        {
+            x = x * 1664525u + 1013904223u;
+            int key = static_cast<int>((x >> 10) % 24);
+            int op = (x >> 5) % 4;
+            if (op == 0)
+            {
+                const int *v = actual.peek(key);
+                assert(actual.contains(key) == (v != NULL));
+                (void)v;
+            }
+            else if (op == 1)
+            {
+                bool found_expected, found_actual;
+                int v_expected = expected.get(key, found_expected);
+                int v_actual = actual.get(key, found_actual);
+                assert(found_expected == found_actual && v_expected == v_actual);
+                (void)v_expected;
+                (void)v_actual;
+            }
+            else
+            {
+                expected.put(key, i);
+                actual.put(key, i);
+            }
+        }
+    }
+
+    // 1从cacheList_淘汰回historyList_头部，但最近访问比3早两个刻度，应先于3超过保留时长；
+    // 尾部检查在3处停止，1由get或put删除并以EXPIRED通知，put写入的是新记录，过期的访问不计入K次
+    for (int by_put = 0; by_put < 2; by_put++)
+    {
+        LRUK_Cache<int, string> retained(1, 2, 100, LogicalClock::duration(20));
+        int expired_1 = 0, demoted = 0;
+        retained.setRemovalListener([&expired_1, &demoted](const int &key, string &&, RemovalCause cause) {
+            if (key == 1 && cause == RemovalCause::EXPIRED)
+                expired_1++;
+            if (cause == RemovalCause::DEMOTED)
+                demoted++;
+        }, true);
+        retained.put(1, "A");
+        retained.put(1, "A");
+        retained.get(4);
+        retained.put(3, "C");
+        retained.put(2, "B");
+        retained.put(2, "B");
+        int ticks = 0;
+        while (retained.contains(1))
+        {
+            retained.get(4);
+            assert(++ticks < 100);
+        }
+        assert(retained.contains(3) && retained.peek(1) == NULL && expired_1 == 0 && demoted == 1);
+        if (by_put)
+            retained.put(1, "A1");
+        else
+            assert(retained.get(1) == NULL);
+        assert(expired_1 == 1 && demoted == 1);
+        retained.put(1, "A1");
+        assert(demoted == 1 + by_put && *retained.peek(1) == "A1");
+        (void)ticks;
+    }
+
+    for (int ghost = 0; ghost < 2; ghost++)
+    {
+        for (int k = 1; k <= 3; k++)
+        {
+            LRUK_Cache<int, int> cache(6, k, 10, LogicalClock::duration(15), ghost != 0, ghost ? 4 : 0);
+            unsigned x = k + ghost * 10;
+            for (int i = 0; i < 3000; i++)
+            {
+                x = x * 1664525u + 1013904223u;
+                int key = static_cast<int>((x >> 10) % 30);
+                if ((x >> 5) & 1)
+                {
+                    bool visible = cache.contains(key) && cache.peek(key) != NULL;
+                    const int *v = cache.get(key);
+                    assert(v == NULL || visible);
+                    (void)v;
+                    (void)visible;
+                }
+                else
+                    cache.put(key, key, LogicalClock::duration((x >> 20) % 30));
+            }
+        }
+    }
+}
+
+// 固定：随机get/put/pin/释放/erase中被固定的数据始终可读且为最后写入的值，不会被淘汰或删除；
+// 缓存数据都被固定时新数据不能晋升；固定期间到期的数据在释放时删除；通过put修改被固定的值时权重随之更新
+void checkPins()
+{
+    typedef LRUK_Cache<int, int> Cache;
+    unsigned x = 1;
+    for (int ghost = 0; ghost < 2; ghost++)
+    {
+        for (int k = 1; k <= 3; k++)
+        {
+            for (int ttl = 0; ttl < 2; ttl++)
+            {
+                Cache cache(8, k, 8, LogicalClock::duration(), ghost != 0, ghost ? 4 : 0);
+                if (ttl)
+                    cache.setDefaultTTL(LogicalClock::duration(40));
+                vector<int> last(24, -1);
+                vector<Cache::Pinned> held;
+                for (int i = 0; i < 20000; i++)
+                {
+                    x = x * 1664525u + 1013904223u;
+                    int key = static_cast<int>((x >> 10) % last.size());
+                    int op = (x >> 5) % 16;
+                    if (op < 5)
+                    {
+                        const int *v = cache.get(key);
+                        assert(v == NULL || *v == last[key]);
+                        (void)v;
+                    }
+                    else if (op < 9)
+                    {
+                        cache.put(key, i);
+                        last[key] = i;
+                    }
+                    else if (op < 12)
+                    {
+                        if (held.size() < 6)
+                        {
+                            Cache::Pinned p = cache.pin(key);
+                            assert(!p || (p.key() == key && *p == last[key]));
+                            if (p)
+                                held.push_back(std::move(p));
+                        }
+                    }
+                    else if (op < 15)
+                    {
+                        if (!held.empty())
+                            held.erase(held.begin() + (x >> 20) % held.size());
+                    }
+                    else
+                    {
+                        bool pinned = false;
+                        for (size_t j = 0; j < held.size(); j++)
+                            pinned = pinned || held[j].key() == key;
+                        bool erased = cache.erase(key);
+                        assert(!pinned || !erased);
+                        (void)pinned;
+                        (void)erased;
+                    }
+                    for (size_t j = 0; j < held.size(); j++)
+                        assert(*held[j] == last[held[j].key()]);
+                    assert(cache.pinnedCount() <= held.size());
+                    cache.checkInvariants();
+                }
+                held.clear();
+                assert(cache.pinnedCount() == 0);
+                cache.checkInvariants();
+            }
+        }
+    }
+
+    for (int k = 1; k <= 2; k++)
+    {
+        Cache full(2, k);
+        for (int i = 0; i < 2; i++)
+        {
+            for (int j = 0; j < k; j++)
+                full.put(i, i);
+        }
+        Cache::Pinned p = full.pin(0), q = full.pin(1);
+        for (int j = 0; j < 5; j++)
+            full.put(9, 9);
+        assert(*p == 0 && *q == 1 && full.weight() == 2 && full.historyWeight() == 1);
+        p.reset();
+        q.reset();
+        full.get(9);
+        full.get(9);
+        assert(full.weight() == 2 && full.historyWeight() == 1 && full.peek(9) != NULL);
+        full.checkInvariants();
+    }
+
+    Cache expiring(4, 1);
+    vector<int> expired;
+    expiring.setRemovalListener([&expired](const int &key, int &&, RemovalCause cause) {
+        if (cause == RemovalCause::EXPIRED)
+            expired.push_back(key);
+    });
+    expiring.put(1, 1, LogicalClock::duration(3));
+    expiring.put(2, 2, LogicalClock::duration(3));
+    Cache::Pinned p = expiring.pin(1), q = expiring.pin(2);
+    for (int i = 0; i < 10; i++)
+        expiring.get(5);
+    assert(*p == 1 && !expiring.contains(1) && expiring.peek(1) == NULL && expired.empty());
+    expiring.put(2, 22);
+    p.reset();
+    assert(expired.size() == 1 && expired[0] == 1);
+    q.reset();
+    assert(expiring.contains(2) && expired.size() == 1);
+
+    // 句柄只保存下标，slab_扩容后仍然有效；同一数据的多个句柄共用引用计数
+    LRUK_Cache<int, string> growing(4, 2, 100000, LogicalClock::duration());
+    growing.put(7, "seven");
+    growing.put(7, "seven");
+    LRUK_Cache<int, string>::Pinned a = growing.pin(7), b = growing.pin(7);
+    assert(growing.pinnedCount() == 1);
+    for (int i = 0; i < 50000; i++)
+        growing.put(1000 + i, "x");
+    assert(*a == "seven" && b->size() == 5);
+    a.reset();
+    assert(growing.pinnedCount() == 1 && !growing.erase(7));
+    b.reset();
+    assert(growing.pinnedCount() == 0 && growing.erase(7));
+
+    // 固定期间通过put修改值：权重立即更新，超出的部分在释放时修剪
+    Cache weighted(8, 1);
+    weighted.setWeigher([](const int &, const int &v) { return static_cast<size_t>(v); }, 10);
+    weighted.put(1, 4);
+    weighted.put(2, 4);
+    Cache::Pinned w1 = weighted.pin(1), w2 = weighted.pin(2);
+    weighted.put(1, 6);
+    assert(*w1 == 6 && weighted.weight() == 10);
+    weighted.put(3, 4);
+    weighted.get(3);
+    assert(weighted.weight() == 14);
+    w1.reset();
+    w2.reset();
+    assert(weighted.weight() <= 10);
+    weighted.checkInvariants();
+}
+
+// ShardedLRUK_Cache：只有一个分片时与参考模型相同；多线程并发读写时读到的值始终是写入的值
+void checkSharded()
+{
+    for (int k = 1; k <= 3; k++)
+    {
+        ShardedLRUK_Cache<int, int> cache(1, 8, k);
+        compareWithReference(cache, 8, k, 24, k);
+    }
+
+    ShardedLRUK_Cache<int, int> cache(16, 256, 2);
+    vector<thread> threads;
+    for (int t = 0; t < 8; t++)
+    {
+        threads.push_back(thread([&cache, t]() {
+            unsigned x = t + 1;
+            for (int i = 0; i < 5000; i++)
+            {
+                x = x * 1664525u + 1013904223u;
+                int key = static_cast<int>((x >> 10) % 1024);
+                bool found;
+                int v = cache.get(key, found);
+                assert(!found || v == key * 7);
+                if (!found)
+                    cache.put(key, key * 7);
+                (void)v;
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+}
+
+#if __cplusplus >= 201703L
+// ConcurrentLRUK_Cache：写入后立即可读；读写线程并发时读到的值始终是写入的值，
+// 淘汰在index_和policy_之间保持一致，只有key的总数不超过两个list的容量
+void checkConcurrent()
+{
+    ConcurrentLRUK_Cache<int, int> single(1, 4, 2);
+    bool found = false;
+    single.put(1, 10);
+    assert(single.contains(1) && single.peek(1, found) == 10 && found && single.get(1, found) == 10 && found);
+    single.put(1, 11);
+    assert(single.get(1, found) == 11 && found);
+    assert(single.erase(1) && !single.contains(1) && single.get(1, found) == 0 && !found);
+    // 读索引扩容、删除和删除后重新写入时已有数据保持可读
+    ConcurrentLRUK_Cache<int, int> grown(1, 1000, 2);
+    for (int i = 0; i < 1000; i++)
+        grown.put(i, i);
+    for (int i = 0; i < 1000; i += 2)
+        grown.erase(i);
+    assert(grown.erase_range(0, 500) == 250);
+    for (int i = 0; i < 1000; i += 4)
+        grown.put(i, -i);
+    for (int i = 0; i < 1000; i++)
+    {
+        int v = grown.peek(i, found);
+        assert(found == (i % 4 == 0 || (i % 2 == 1 && i >= 500)) && (!found || v == (i % 4 == 0 ? -i : i)));
+        (void)v;
+    }
+    grown.clear();
+    assert(!grown.contains(999));
+    // 读缓冲区中的命中回放到policy_后晋升，之后新写入的key只会挤掉历史记录
+    ConcurrentLRUK_Cache<int, int> replayed(1, 2, 2);
+    replayed.put(1, 1);
+    for (int i = 0; i < 64; i++)
+        replayed.get(1, found);
+    replayed.put(2, 2);
+    replayed.put(3, 3);
+    replayed.put(4, 4);
+    assert(replayed.contains(1) && !replayed.contains(2));
+
+    ConcurrentLRUK_Cache<int, int> cache(8, 256, 2);
+    vector<thread> threads;
+    for (int t = 0; t < 8; t++)
+    {
+        threads.push_back(thread([&cache, t]() {
+            unsigned x = t + 1;
+            for (int i = 0; i < 20000; i++)
+            {
+                x = x * 1664525u + 1013904223u;
+                int key = static_cast<int>((x >> 10) % 1024);
+                bool hit;
+                int v = cache.get(key, hit);
+                assert(!hit || v == key * 7);
+                if (!hit && (x >> 4) % 4 == 0)
+                    cache.put(key, key * 7);
+                (void)v;
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+    int present = 0;
+    for (int key = 0; key < 1024; key++)
+        present += cache.contains(key);
+    assert(present <= 512);
+    (void)present;
+
+    // 一个线程不断覆盖和删除，其他线程同时读取：被替换的值在读取结束前不会被释放（配合ASan检查）
+    ConcurrentLRUK_Cache<int, string> strings(2, 64, 1);
+    atomic<bool> stop(false);
+    threads.clear();
+    for (int t = 0; t < 4; t++)
+    {
+        threads.push_back(thread([&strings, &stop, t]() {
+            unsigned x = t + 1;
+            while (!stop.load())
+            {
+                x = x * 1664525u + 1013904223u;
+                int key = static_cast<int>((x >> 10) % 64);
+                bool hit;
+                string v = strings.get(key, hit);
+                assert(!hit || (v.size() >= 100 && v.find_first_not_of(static_cast<char>('a' + key % 26)) == string::npos));
+            }
+        }));
+    }
+    for (int i = 0; i < 100000; i++)
+    {
+        int key = i % 64;
+        if (i % 7 == 0)
+            strings.erase(key);
+        else
+            strings.put(key, string(100 + i % 50, static_cast<char>('a' + key % 26)));
+    }
+    stop.store(true);
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+}
+#endif
+
+// getMany/putMany：写入后的值都能查到；历史容量容得下所有key、查找不会丢弃记录时，
+// getMany的结果与查找前peek的结果相同；缓存较大、堆调整推迟到组末时堆仍然合法
+void checkBatch()
+{
+    for (int k = 1; k <= 3; k++)
+    {
+        LRUK_Cache<int, int> cache(64, k, 160, LogicalClock::duration());
+        vector<int> keys(200), values(200);
+        unique_ptr<bool[]> found(new bool[200]);
+        unsigned x = k;
+        for (int round = 0; round < 50; round++)
+        {
+            for (int i = 0; i < 200; i++)
+            {
+                x = x * 1664525u + 1013904223u;
+                keys[i] = static_cast<int>((x >> 10) % 160);
+                values[i] = keys[i] * 3;
+            }
+            cache.putMany(&keys[0], &values[0], 100);
+            for (int i = 0; i < 100; i++)
+                assert(*cache.peek(keys[i]) == keys[i] * 3);
+            vector<bool> present(200);
+            size_t expected_hits = 0;
+            for (int i = 100; i < 200; i++)
+            {
+                present[i] = cache.contains(keys[i]);
+                expected_hits += present[i];
+            }
+            size_t hits = cache.getMany(&keys[100], 100, &values[100], found.get() + 100);
+            assert(hits == expected_hits);
+            for (int i = 100; i < 200; i++)
+                assert(found[i] == present[i] && (!found[i] || values[i] == keys[i] * 3));
+            cache.checkInvariants();
+            (void)hits;
+        }
+    }
+
+    // 堆不小于DEFER_SIFT_MIN时组内的堆调整推迟到组末。逐个写入使每条记录的访问时间不同，
+    // 再乱序批量查找其中一部分，推迟的调整遗漏或顺序错误时堆不再合法
+    LRUK_Cache<int, int> large(70000, 2);
+    for (int i = 0; i < 70000; i++)
+    {
+        large.put(i, i);
+        large.put(i, i);
+    }
+    vector<int> keys(20000), values(20000);
+    unique_ptr<bool[]> found(new bool[keys.size()]);
+    unsigned x = 7;
+    for (int round = 0; round < 3; round++)
+    {
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            x = x * 1664525u + 1013904223u;
+            keys[i] = static_cast<int>((x >> 8) % 70000);
+        }
+        size_t hits = large.getMany(&keys[0], keys.size(), &values[0], found.get());
+        assert(hits == keys.size());
+        (void)hits;
+        large.checkInvariants();
+    }
+}
+
+// get_or_load：同一key并发未命中时只加载一次；加载函数抛出的异常交给所有等待者；
+// 加载期间被erase的key，加载结果只返回给调用者，不写入缓存
+void checkLoad()
+{
+    ShardedLRUK_Cache<int, int> cache(4, 64, 2);
+    atomic<int> calls(0);
+    vector<thread> threads;
+    for (int t = 0; t < 8; t++)
+    {
+        threads.push_back(thread([&cache, &calls]() {
+            int v = cache.get_or_load(1, [&calls](const int &k) {
+                calls++;
+                this_thread::sleep_for(milliseconds(20));
+                return k * 10;
+            });
+            assert(v == 10);
+            (void)v;
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+    LoadStats stats = cache.loadStats();
+    assert(calls == 1 && stats.loads_ == 1 && stats.hits_ + stats.coalesced_ == 7);
+
+    atomic<int> thrown(0);
+    threads.clear();
+    for (int t = 0; t < 8; t++)
+    {
+        threads.push_back(thread([&cache, &thrown]() {
+            try
+            {
+                cache.get_or_load(2, [](const int &) -> int {
+                    this_thread::sleep_for(milliseconds(20));
+                    throw 2;
+                });
+            }
+            catch (int)
+            {
+                thrown++;
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+    stats = cache.loadStats();
+    assert(thrown == 8 && stats.failures_ + 1 == stats.loads_ && stats.loads_ + stats.hits_ + stats.coalesced_ == 16);
+    bool found;
+    assert(cache.get_or_load(2, [](const int &) { return 20; }) == 20 && cache.get(2, found) == 20 && found);
+
+    atomic<bool> started(false);
+    thread loader([&cache, &started]() {
+        int v = cache.get_or_load(3, [&started](const int &) {
+            started = true;
+            this_thread::sleep_for(milliseconds(20));
+            return 30;
+        });
+        assert(v == 30);
+        (void)v;
+    });
+    while (!started)
+        this_thread::yield();
+    cache.erase(3);
+    loader.join();
+    assert(!cache.contains(3));
+    (void)stats;
+}
+
+#if defined(__cpp_impl_coroutine) && __cplusplus >= 202002L
+// checkAsync的加载协程：yield几次模拟异步I/O，k为负数时抛出异常
+Task<string> asyncCheckLoad(SingleThreadExecutor &executor, int &loads, int k)
+{
+    loads++;
+    for (int i = 0; i < 3; i++)
+        co_await executor.yield();
+    if (k < 0)
+        throw k;
+    co_return to_string(k);
+}
+
+// checkAsync的客户端协程，统计成功和收到异常的次数
+Task<void> asyncCheckClient(SingleThreadExecutor &executor, AsyncLRUK_Cache<int, string> &cache, int k, int &loads,
+                            int &done, int &errors)
+{
+    try
+    {
+        string v = co_await cache.async_get(k, [&executor, &loads](const int &key) {
+            return asyncCheckLoad(executor, loads, key);
+        });
+        assert(v == to_string(k));
+        done++;
+    }
+    catch (int)
+    {
+        errors++;
+    }
+}
+
+// 同一个协程中连续n次co_await async_get读取0到4，都已在缓存中
+Task<void> asyncCheckHits(SingleThreadExecutor &executor, AsyncLRUK_Cache<int, string> &cache, int n, int &loads, int &read)
+{
+    for (int i = 0; i < n; i++)
+    {
+        string v = co_await cache.async_get(i % 5, [&executor, &loads](const int &key) {
+            return asyncCheckLoad(executor, loads, key);
+        });
+        assert(v == to_string(i % 5));
+        read++;
+    }
+}
+
+// 在k的加载进行中erase它，或put一个新值
+Task<void> asyncCheckDuringLoad(SingleThreadExecutor &executor, AsyncLRUK_Cache<int, string> &cache, int k, bool erase)
+{
+    co_await executor.yield();
+    if (erase)
+        cache.erase(k);
+    else
+        cache.cache().put(k, "put");
+}
+
+// async_get：同一key的并发未命中只加载一次，加载协程的异常交给所有等待者，
+// 加载完成后命中，命中时不挂起；加载期间erase的结果不写入缓存，加载期间put的值优先保留
+void checkAsync()
+{
+    SingleThreadExecutor executor;
+    AsyncLRUK_Cache<int, string> cache(executor, 10, 2);
+    int loads = 0, done = 0, errors = 0;
+    for (int i = 0; i < 100; i++)
+        executor.spawn(asyncCheckClient(executor, cache, i % 5, loads, done, errors));
+    for (int i = 0; i < 10; i++)
+        executor.spawn(asyncCheckClient(executor, cache, -1, loads, done, errors));
+    executor.run();
+    LoadStats stats = cache.loadStats();
+    assert(done == 100 && errors == 10 && loads == 6);
+    assert(stats.loads_ == 6 && stats.coalesced_ == 104 && stats.failures_ == 1 && stats.hits_ == 0);
+
+    for (int i = 0; i < 5; i++)
+        executor.spawn(asyncCheckClient(executor, cache, i, loads, done, errors));
+    executor.run();
+    assert(loads == 6 && done == 105 && cache.loadStats().hits_ == 5);
+
+    // 命中时co_await不挂起：一个协程连续命中100万次，执行器只恢复它一次，调用栈也不会随之加深
+    int read = 0;
+    executor.spawn(asyncCheckHits(executor, cache, 1000000, loads, read));
+    size_t resumed = executor.run();
+    assert(read == 1000000 && resumed == 1 && loads == 6 && cache.loadStats().hits_ == 1000005);
+    (void)resumed;
+
+    executor.spawn(asyncCheckClient(executor, cache, 8, loads, done, errors));
+    executor.spawn(asyncCheckDuringLoad(executor, cache, 8, true));
+    executor.spawn(asyncCheckClient(executor, cache, 9, loads, done, errors));
+    executor.spawn(asyncCheckDuringLoad(executor, cache, 9, false));
+    executor.run();
+    assert(loads == 8 && done == 107 && !cache.cache().contains(8));
+    assert(cache.cache().peek(9) != NULL && *cache.cache().peek(9) == "put");
+    (void)stats;
+}
+#endif
+
+void runSelfChecks()
+{
+    checkAgainstReference();
+    checkInvariantsUnderRandomOps();
+    checkFlatIndex();
+    checkErase();
+    checkTTL();
+    checkResize();
+    checkListener();
+    checkPeek();
+    checkPins();
+    checkSharded();
+#if __cplusplus >= 201703L
+    checkConcurrent();
+#endif
+    checkBatch();
+    checkLoad();
+#if defined(__cpp_impl_coroutine) && __cplusplus >= 202002L
+    checkAsync();
+#endif
+}
+
+// 从start到现在的平均每次操作耗时(ns)
+double nsPerOp(steady_clock::time_point start, size_t ops)
+{
+    return duration<double, nano>(steady_clock::now() - start).count() / ops;
+}
+
+// 所有key都在cacheList_中时随机get的每次耗时，K=2，容量从1k到10M。
+// 历史容量只需容纳写入两次之间的记录，设为1024，10M条数据时内存主要是cacheList_的记录和索引
+void benchHitLatency()
+{
+    const int OPS = 2000000;
+    cout << "hit latency: capacity, get ns per op\n";
+    for (int c = 1000; c <= 10000000; c *= 10)
+    {
+        LRUK_Cache<long, long> cache(c, 2, 1024, LogicalClock::duration());
+        for (long key = 0; key < c; key++)
+        {
+            cache.put(key, key);
+            cache.put(key, key);
+        }
+        vector<long> keys(OPS);
+        unsigned x = 1;
+        for (int i = 0; i < OPS; i++)
+        {
+            x = x * 1664525u + 1013904223u;
+            keys[i] = static_cast<long>((static_cast<uint64_t>(x) * 2654435761u) % c);
+        }
+        long sum = 0;
+        steady_clock::time_point start = steady_clock::now();
+        for (int i = 0; i < OPS; i++)
+            sum += *cache.get(keys[i]);
+        cout << c << "\t" << nsPerOp(start, OPS) << "\t(sum " << sum << ")\n";
+    }
+}
+
+// 晋升的代价：cacheList_已满，每次put一个新key后立即get使其晋升，从cacheList_淘汰一条数据回到historyList_，
+// 计时包括这一对put和get，K=2
+void benchPromotion()
+{
+    const int OPS = 1000000;
+    const int capacities[3] = {1000, 100000, 1000000};
+    cout << "promotion: capacity, put + promoting get ns per op\n";
+    for (int i = 0; i < 3; i++)
+    {
+        int c = capacities[i];
+        LRUK_Cache<long, long> cache(c, 2);
+        for (long key = 0; key < c; key++)
+        {
+            cache.put(key, key);
+            cache.put(key, key);
+        }
+        long sum = 0;
+        steady_clock::time_point start = steady_clock::now();
+        for (long key = c; key < c + OPS; key++)
+        {
+            cache.put(key, key);
+            sum += *cache.get(key);
+        }
+        cout << c << "\t" << nsPerOp(start, OPS) << "\t(sum " << sum << ")\n";
+    }
+}
+
+// 性能测试用的分配计数：CountingAllocator的分配次数和当前占用的字节数，只在单线程测试中使用
+struct AllocStats
+{
+    static size_t allocs_;
+    static size_t bytes_;
+};
+
+size_t AllocStats::allocs_ = 0;
+size_t AllocStats::bytes_ = 0;
+
+// 经operator new分配并计入AllocStats的分配器，用作LRUK_Cache的ALLOC或值类型的分配器
+template <typename T>
+class CountingAllocator
+{
+public:
+    typedef T value_type;
+
+    CountingAllocator() {}
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U> &) {}
 
-    CacheEntry(KEY k, VALUE v) : key_(k), value_(v) {}
+    T *allocate(size_t n)
+    {
+        AllocStats::allocs_++;
+        AllocStats::bytes_ += n * sizeof(T);
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        AllocStats::bytes_ -= n * sizeof(T);
+        ::operator delete(p);
+    }
 };
 
-//cachelist排序比较函数，时间从新到旧的顺序排序
-template <typename KEY, typename VALUE>
-bool compareByAccessTime(const CacheEntry<KEY, VALUE>& a, const CacheEntry<KEY, VALUE>& b) {
-    return a.access_time_.front() > b.access_time_.front();  // 最新的时间排在前面
+template <typename T, typename U>
+bool operator==(const CountingAllocator<T> &, const CountingAllocator<U> &) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const CountingAllocator<T> &, const CountingAllocator<U> &) { return false; }
+
+typedef basic_string<char, char_traits<char>, CountingAllocator<char> > CountedString;
+
+// 完整历史与ghost模式的内存对比：容量2000，K=2，2万个key按偏斜分布get，未命中时put 4KB的值，共50万次，
+// 报告命中率和结束时缓存占用的堆内存（记录、索引、暂存区和值）
+void benchGhostMemory()
+{
+    typedef LRUK_Cache<int, CountedString, 0, LogicalClock, CountingAllocator<char> > Cache;
+    const int CAPACITY = 2000, KEYS = 20000, OPS = 500000, VALUE_SIZE = 4096;
+    cout << "ghost memory: mode, staging capacity, hit ratio, heap MB\n";
+    const int staging[4] = {-1, 0, 500, 2000};  // -1表示完整历史
+    for (int i = 0; i < 4; i++)
+    {
+        size_t bytes_before = AllocStats::bytes_;
+        size_t hits = 0, bytes;
+        {
+            Cache cache(CAPACITY, 2, staging[i] >= 0, max(staging[i], 0));
+            unsigned x = 1;
+            for (int j = 0; j < OPS; j++)
+            {
+                x = x * 1664525u + 1013904223u;
+                double u = (x >> 8) / 16777216.0;
+                int key = static_cast<int>(KEYS * u * u * u);
+                if (cache.get(key) != NULL)
+                    hits++;
+                else
+                    cache.put(key, CountedString(VALUE_SIZE, 'v'));
+            }
+            bytes = AllocStats::bytes_ - bytes_before;
+        }
+        cout << (staging[i] < 0 ? "full" : "ghost") << "\t" << max(staging[i], 0) << "\t"
+             << static_cast<double>(hits) / OPS << "\t" << bytes / 1048576.0 << "\n";
+    }
 }
 
-template <typename KEY, typename VALUE>
-class LRUK_Cache
+// put()新key的开销：容量100万，K=2，依次put 100万个新key（都进入historyList_），
+// 报告每次put的分配次数、每条记录占用的堆内存（经CountingAllocator统计）和耗时
+void benchPutNew()
 {
-    int capacity_;                                                           // 最大可缓存上限
-    int k_;                                                                  // 超过K次之后可移入cacheList
-    list<CacheEntry<KEY, VALUE> > historyList_;                              // 保存历史记录，超过K次访问后移入cacheList。
-    list<CacheEntry<KEY, VALUE> > cacheList_;                                // 保存热数据记录，查找时优先查找。
-    unordered_map<KEY, typename list<CacheEntry<KEY, VALUE> >::iterator> history_map_; // 用于快速定位historyList_
-    unordered_map<KEY, typename list<CacheEntry<KEY, VALUE> >::iterator> cache_map_;   // 用于快速定位cacheList_
+    const int N = 1000000;
+    cout << "put new: allocs per op, heap bytes per entry, ns per op\n";
+    size_t allocs_before = AllocStats::allocs_, bytes_before = AllocStats::bytes_;
+    LRUK_Cache<long, long, 0, LogicalClock, CountingAllocator<char> > cache(N, 2);
+    steady_clock::time_point start = steady_clock::now();
+    for (long key = 0; key < N; key++)
+        cache.put(key, key);
+    double ns = nsPerOp(start, N);
+    cout << static_cast<double>(AllocStats::allocs_ - allocs_before) / N << "\t"
+         << static_cast<double>(AllocStats::bytes_ - bytes_before) / N << "\t" << ns
+         << "\t(history weight " << cache.historyWeight() << ")\n";
+}
 
-    typename list<CacheEntry<KEY, VALUE> >::iterator findVictimFromCache()
+// 随机命中的平均耗时：先把0..c-1各put k次使其全部进入cacheList_，再随机get 200万次
+template <typename CACHE>
+double hitLatency(CACHE &cache, int c, int k)
+{
+    const int OPS = 2000000;
+    for (long key = 0; key < c; key++)
+        for (int i = 0; i < k; i++)
+            cache.put(key, key);
+    vector<long> keys(OPS);
+    unsigned x = 1;
+    for (int i = 0; i < OPS; i++)
     {
-        // cachelist中已经是按时间从新到旧的顺序排序了，因此list中最后一元素就是需要被淘汰的数据
-        return --cacheList_.end();
+        x = x * 1664525u + 1013904223u;
+        keys[i] = static_cast<long>((static_cast<uint64_t>(x) * 2654435761u) % c);
     }
+    long sum = 0;
+    steady_clock::time_point start = steady_clock::now();
+    for (int i = 0; i < OPS; i++)
+        sum += *cache.get(keys[i]);
+    double ns = nsPerOp(start, OPS);
+    if (sum < 0)
+        cout << "unexpected sum " << sum << "\n";
+    return ns;
+}
 
-    typename list<CacheEntry<KEY, VALUE> >::iterator findVictimFromHistory()
+// 运行期K与编译期K的命中耗时对比
+void benchCompileTimeK()
+{
+    cout << "compile-time K: capacity, K, runtime K ns per op, compile-time K ns per op\n";
+    for (int c = 1000; c <= 100000; c *= 100)
     {
-        // historylist按先进先出的原则淘汰数据,最早的数据在尾部
-        return --historyList_.end();
+        for (int k = 1; k <= 3; k++)
+        {
+            LRUK_Cache<long, long> runtime(c, k);
+            double runtime_ns = hitLatency(runtime, c, k), compiled_ns = 0;
+            if (k == 1)
+            {
+                LRUK_Cache<long, long, 1> compiled(c);
+                compiled_ns = hitLatency(compiled, c, k);
+            }
+            else if (k == 2)
+            {
+                LRUK_Cache<long, long, 2> compiled(c);
+                compiled_ns = hitLatency(compiled, c, k);
+            }
+            else
+            {
+                LRUK_Cache<long, long, 3> compiled(c);
+                compiled_ns = hitLatency(compiled, c, k);
+            }
+            cout << c << "\t" << k << "\t" << runtime_ns << "\t" << compiled_ns << "\n";
+        }
     }
-    
-    // 根据k查找cachelist中的元素
-    typename list<CacheEntry<KEY, VALUE> >::iterator findCacheEntry(const KEY &k)
+}
+
+// SteadyClock与LogicalClock的命中耗时对比，运行期K
+void benchClock()
+{
+    cout << "clock: capacity, K, SteadyClock ns per op, LogicalClock ns per op\n";
+    for (int c = 1000; c <= 100000; c *= 100)
     {
-        typename list<CacheEntry<KEY, VALUE> >::iterator ret = cacheList_.begin();
-        for (; ret != cacheList_.end(); ret++)
+        for (int k = 2; k >= 1; k--)
         {
-            if (ret->key_ == k)
-                break;
+            LRUK_Cache<long, long, 0, SteadyClock> steady(c, k);
+            LRUK_Cache<long, long, 0, LogicalClock> logical(c, k);
+            double steady_ns = hitLatency(steady, c, k);
+            cout << c << "\t" << k << "\t" << steady_ns << "\t" << hitLatency(logical, c, k) << "\n";
         }
-        return ret;
     }
+}
+
+// 大值的读取：1万条4KB字符串全部命中，K=2，对比按值返回的get(k, found)与返回指针的get(k)，
+// 报告耗时和每次调用的分配次数
+void benchGetPointer()
+{
+    const int N = 10000, OPS = 1000000;
+    LRUK_Cache<int, CountedString> cache(N, 2);
+    for (int key = 0; key < N; key++)
+    {
+        cache.put(key, CountedString(4096, 'v'));
+        cache.put(key, CountedString(4096, 'v'));
+    }
+    vector<int> keys(OPS);
+    unsigned x = 1;
+    for (int i = 0; i < OPS; i++)
+    {
+        x = x * 1664525u + 1013904223u;
+        keys[i] = static_cast<int>((x >> 8) % N);
+    }
+    cout << "get pointer: form, ns per op, allocs per op\n";
+    size_t sum = 0, allocs_before = AllocStats::allocs_;
+    steady_clock::time_point start = steady_clock::now();
+    for (int i = 0; i < OPS; i++)
+    {
+        bool found;
+        CountedString v = cache.get(keys[i], found);
+        sum += v.size();
+    }
+    double ns = nsPerOp(start, OPS);
+    cout << "by value\t" << ns << "\t" << static_cast<double>(AllocStats::allocs_ - allocs_before) / OPS << "\n";
+    allocs_before = AllocStats::allocs_;
+    start = steady_clock::now();
+    for (int i = 0; i < OPS; i++)
+        sum += cache.get(keys[i])->size();
+    ns = nsPerOp(start, OPS);
+    cout << "pointer\t" << ns << "\t" << static_cast<double>(AllocStats::allocs_ - allocs_before) / OPS
+         << "\t(sum " << sum << ")\n";
+}
 
-    //从cachelist中查找元素，如果找到，需要更新时间，然后根据时间进行重排序
-    typename list<CacheEntry<KEY, VALUE> >::iterator getFromCacheList(const KEY &k)
+// 索引查找的耗时：100万和1000万个key全部在cacheList_中，K=2，分别随机get命中、get未命中(key+n)和contains
+void benchLookup()
+{
+    const int OPS = 2000000;
+    cout << "lookup: keys, get hit, get miss, contains ns per op\n";
+    for (long n = 1000000; n <= 10000000; n *= 10)
     {
-        typename list<CacheEntry<KEY, VALUE> >::iterator ret = cacheList_.end();
-        typename unordered_map<KEY, typename list<CacheEntry<KEY, VALUE> >::iterator>::iterator it = cache_map_.find(k);
-        if (it != cache_map_.end())
+        LRUK_Cache<long, long, 2> cache(static_cast<int>(n));
+        for (long key = 0; key < n; key++)
+        {
+            cache.put(key, key);
+            cache.put(key, key);
+        }
+        vector<long> keys(OPS);
+        unsigned x = 1;
+        for (int i = 0; i < OPS; i++)
         {
-            //找到key对应的数据
-            it->second->access_time_.push(steady_clock::now());
-            //只记录前K次时间
-            if (it->second->access_time_.size() > k_)
+            x = x * 1664525u + 1013904223u;
+            keys[i] = static_cast<long>((static_cast<uint64_t>(x) * 2654435761u) % n);
+        }
+        double ns[3];
+        size_t hits = 0;
+        for (int mode = 0; mode < 3; mode++)
+        {
+            steady_clock::time_point start = steady_clock::now();
+            for (int i = 0; i < OPS; i++)
             {
-                it->second->access_time_.pop();
-                //这里由于将最老的访问时间移除了，因此需要重新排序
-                cacheList_.sort(compareByAccessTime<KEY,VALUE>);
-                ret = findCacheEntry(k);
-                cache_map_.erase(k);
-                cache_map_.emplace(k,ret);
+                if (mode == 0)
+                    hits += cache.get(keys[i]) != NULL;
+                else if (mode == 1)
+                    hits += cache.get(keys[i] + n) != NULL;
+                else
+                    hits += cache.contains(keys[i]);
             }
+            ns[mode] = nsPerOp(start, OPS);
         }
-        return ret;
+        cout << n << "\t" << ns[0] << "\t" << ns[1] << "\t" << ns[2] << "\t(hits " << hits << ")\n";
     }
+}
 
-    // 从历史数据中查找元素
-    // 如果找到，更新时间，然后：
-    //    当热度大于等于k时，如果cachelist没有满，则插入cachelist，重新排序。
-    //        如果满了则先从cachelist中找到最老的数据，移回到historylist头部，再将查找的数据移入cachelist中，重新排序。
-    //    当热度小于k时：
-    //        将元素移到historylist头部。
-    typename list<CacheEntry<KEY, VALUE> >::iterator getFromHistoryList(const KEY &k)
-    {
-        typename list<CacheEntry<KEY, VALUE> >::iterator ret = historyList_.end();
-        typename unordered_map<KEY, typename list<CacheEntry<KEY, VALUE> >::iterator>::iterator it = history_map_.find(k);
-        if (it != history_map_.end())
-        {
-            //找到key对应的数据
-            typename list<CacheEntry<KEY, VALUE> >::iterator entry_it = it->second;
-            ret = entry_it;
-            entry_it->access_time_.push(steady_clock::now());
-            // 超过K次访问，变为热数据
-            if (entry_it->access_time_.size() >= k_)
-            {
-                if (entry_it->access_time_.size() > k_)
-                    entry_it->access_time_.pop();
-                // cacheList_没有满，可以直接插入
-                if (cacheList_.size() < capacity_)
-                {
-                    cacheList_.emplace(cacheList_.end(),*entry_it);
-                    //cache_map_.emplace(k,cacheList_.begin());
-                    //从历史数据中移除
-                    history_map_.erase(entry_it->key_);
-                    historyList_.erase(entry_it);
-                    //重新排序
-                    cacheList_.sort(compareByAccessTime<KEY,VALUE>);
-                    ret = findCacheEntry(k);
-                    cache_map_.emplace(k,ret);
-                }
-                else
-                {
-                    // cacheList_满了，需要淘汰一个到historyList_
-                    typename list<CacheEntry<KEY, VALUE> >::iterator vict = findVictimFromCache();
-                    cacheList_.emplace(cacheList_.end(),*entry_it);
-                    //cache_map_.emplace((*entry_it).key_,cacheList_.begin());
-                    //从cacheList_淘汰的回到历史数据头部
-                    historyList_.emplace_front(*vict);
-                    history_map_.emplace((*vict).key_,historyList_.begin());
-                    //删除
-                    cache_map_.erase(vict->key_);
-                    cacheList_.erase(vict);
-                    history_map_.erase(entry_it->key_);
-                    historyList_.erase(entry_it);
-                    //重新排序
-                    cacheList_.sort(compareByAccessTime<KEY,VALUE>);
-                    ret = findCacheEntry(k);
-                    cache_map_.emplace(k,ret);
-                }
-            }
-            // 没有超过K次，保留在历史数据中
+// 哈希次数统计用的key，std::hash<HashCountedKey>每调用一次计数加1
+struct HashCountedKey
+{
+    long v_;
+
+    HashCountedKey(long v = 0) : v_(v) {}
+    bool operator==(const HashCountedKey &other) const { return v_ == other.v_; }
+
+    static size_t hashes_;
+};
+
+size_t HashCountedKey::hashes_ = 0;
+
+namespace std
+{
+template <>
+struct hash<HashCountedKey>
+{
+    size_t operator()(const HashCountedKey &k) const
+    {
+        HashCountedKey::hashes_++;
+        return hash<long>()(k.v_);
+    }
+};
+}
+
+// 每次操作的哈希次数和耗时：容量10万，K=2，cacheList_中10万个热key，historyList_中10万个冷key，
+// 分别随机get命中、get未命中、put已有key和put新key（淘汰historyList_尾部）
+void benchHashes()
+{
+    const int N = 100000, OPS = 1000000;
+    LRUK_Cache<HashCountedKey, long> cache(N, 2);
+    for (long key = 0; key < N; key++)
+    {
+        cache.put(key, key);
+        cache.put(key, key);
+    }
+    for (long key = N; key < 2 * N; key++)
+        cache.put(key, key);
+    vector<long> keys(OPS);
+    unsigned x = 1;
+    for (int i = 0; i < OPS; i++)
+    {
+        x = x * 1664525u + 1013904223u;
+        keys[i] = static_cast<long>((static_cast<uint64_t>(x) * 2654435761u) % N);
+    }
+    cout << "hashes: op, hashes per op, ns per op\n";
+    const char *names[4] = {"get hit", "get miss", "put existing", "put new"};
+    long sum = 0, next = 2 * N;
+    for (int mode = 0; mode < 4; mode++)
+    {
+        size_t hashes_before = HashCountedKey::hashes_;
+        steady_clock::time_point start = steady_clock::now();
+        for (int i = 0; i < OPS; i++)
+        {
+            if (mode == 0)
+                sum += *cache.get(keys[i]);
+            else if (mode == 1)
+                sum += cache.get(keys[i] + 10 * N) != NULL;
+            else if (mode == 2)
+                cache.put(keys[i], keys[i]);
             else
-            {
-                // 将刚查询的entry移动到头部
-                historyList_.splice(historyList_.begin(), historyList_, entry_it);
-            }
+                cache.put(next++, 0);
         }
-
-        return ret;
+        double ns = nsPerOp(start, OPS);
+        cout << names[mode] << "\t" << static_cast<double>(HashCountedKey::hashes_ - hashes_before) / OPS << "\t" << ns << "\n";
     }
+    cout << "(sum " << sum << ")\n";
+}
 
-public:
-    LRUK_Cache(int c, int k) : capacity_(c), k_(k) {}
+// 当前进程的常驻内存(MB)，读取/proc/self/status中的VmRSS，非Linux平台返回0
+double residentMB()
+{
+#if defined(__linux__)
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line))
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            return atol(line.c_str() + 6) / 1024.0;
+#endif
+    return 0;
+}
 
-    VALUE get(KEY k, bool &found)
+// 稳态的分配次数：容量100万，K=2，300万个key上随机get-or-put，先预热400万次再统计400万次，
+// 报告构造、预热和稳态的分配次数，以及缓存占用的堆内存和进程的常驻内存
+void benchSteadyAllocs()
+{
+    const int CAPACITY = 1000000, KEYS = 3000000, OPS = 4000000;
+    cout << "steady allocs: constructor allocs, warm-up allocs, steady allocs per op, heap MB, RSS MB\n";
+    size_t allocs_before = AllocStats::allocs_, bytes_before = AllocStats::bytes_;
+    LRUK_Cache<long, long, 0, LogicalClock, CountingAllocator<char> > cache(CAPACITY, 2);
+    size_t constructor_allocs = AllocStats::allocs_ - allocs_before, warm_up_allocs = 0;
+    unsigned x = 1;
+    long sum = 0;
+    for (int round = 0; round < 2; round++)
     {
-        // 先从cache中查找
-        typename list<CacheEntry<KEY, VALUE> >::iterator entry_it = getFromCacheList(k);
-        if (entry_it != cacheList_.end())
+        allocs_before = AllocStats::allocs_;
+        for (int i = 0; i < OPS; i++)
         {
-            //找到
-            found = true;
-            return entry_it->value_;
+            x = x * 1664525u + 1013904223u;
+            long key = static_cast<long>((static_cast<uint64_t>(x) * 2654435761u) % KEYS);
+            const long *v = cache.get(key);
+            if (v != NULL)
+                sum += *v;
+            else
+                cache.put(key, key);
         }
+        if (round == 0)
+            warm_up_allocs = AllocStats::allocs_ - allocs_before;
+    }
+    cout << constructor_allocs << "\t" << warm_up_allocs << "\t"
+         << static_cast<double>(AllocStats::allocs_ - allocs_before) / OPS << "\t"
+         << (AllocStats::bytes_ - bytes_before) / 1048576.0 << "\t" << residentMB() << "\t(sum " << sum << ")\n";
+}
 
-        // 从历史数据中查找
-        entry_it = getFromHistoryList(k);
-        if (entry_it != historyList_.end())
+// 大量小缓存实例的创建、使用和销毁：1000个容量256、运行期K=8、ghost模式暂存256个值的实例，
+// 400万次put轮流分给各实例，每个实例的key随机取自4096个，计时包括构造和析构，返回每秒百万次put
+template <typename ALLOC>
+double churn(const ALLOC &alloc)
+{
+    typedef LRUK_Cache<long, long, 0, LogicalClock, ALLOC> Cache;
+    const int INSTANCES = 1000, KEYS = 4096, OPS = 4000000;
+    steady_clock::time_point start = steady_clock::now();
+    {
+        vector<unique_ptr<Cache> > caches;
+        for (int i = 0; i < INSTANCES; i++)
+            caches.push_back(unique_ptr<Cache>(new Cache(256, 8, true, 256, alloc)));
+        unsigned x = 1;
+        for (int i = 0; i < OPS; i++)
         {
-            //找到
-            found = true;
-            return entry_it->value_;
+            x = x * 1664525u + 1013904223u;
+            long key = (x >> 8) % KEYS;
+            caches[i % INSTANCES]->put(key, key);
         }
-        //未从任何缓存中找到
-        found = false;
-        return VALUE();
+    }
+    return static_cast<double>(OPS) / duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+// 分配器对多实例场景的影响：std::allocator、共用一个CacheArena、C++17的pmr::unsynchronized_pool_resource
+void benchChurn()
+{
+    cout << "churn: allocator, Mops per second\n";
+    cout << "std::allocator\t" << churn(allocator<char>()) << "\n";
+    {
+        CacheArena arena;
+        cout << "CacheArena\t" << churn(ArenaAllocator<char>(&arena)) << "\n";
+    }
+#if __cplusplus >= 201703L
+    {
+        pmr::unsynchronized_pool_resource pool;
+        cout << "pmr::unsynchronized_pool_resource\t" << churn(pmr::polymorphic_allocator<char>(&pool)) << "\n";
+    }
+#endif
+}
+
+// 整体加一把锁的LRUK_Cache，作为并发性能测试的对比基准
+template <typename KEY, typename VALUE>
+class LockedLRUK_Cache
+{
+    mutex lock_;
+    LRUK_Cache<KEY, VALUE> cache_;
+
+public:
+    LockedLRUK_Cache(int c, int k) : cache_(c, k) {}
+
+    VALUE get(const KEY &k, bool &found)
+    {
+        lock_guard<mutex> guard(lock_);
+        return cache_.get(k, found);
+    }
+
+    void put(const KEY &k, const VALUE &v)
+    {
+        lock_guard<mutex> guard(lock_);
+        cache_.put(k, v);
+    }
+};
+
+// threads个线程各执行ops次操作，get占get_percent%，key在[0, keys)中均匀分布，未命中的get随后put。
+// 返回墙钟时间除以总操作数，线程扩展性好时随线程数下降
+template <typename CACHE>
+double benchMixed(CACHE &cache, int threads, int ops, int get_percent, int keys)
+{
+    vector<thread> workers;
+    steady_clock::time_point start = steady_clock::now();
+    for (int t = 0; t < threads; t++)
+    {
+        workers.push_back(thread([&cache, t, ops, get_percent, keys]() {
+            unsigned x = t * 7919 + 1;
+            for (int i = 0; i < ops; i++)
+            {
+                x = x * 1664525u + 1013904223u;
+                int key = static_cast<int>((x >> 8) % keys);
+                bool found = false;
+                if (static_cast<int>((x >> 24) % 100) < get_percent)
+                    cache.get(key, found);
+                if (!found)
+                    cache.put(key, key);
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+    return nsPerOp(start, static_cast<size_t>(threads) * ops);
+}
 
+// 1到64个线程下，整体一把锁与64个分片的对比，get为主(95%)和put为主(50%)两种负载
+void benchSharded()
+{
+    cout << "sharded: threads, get-heavy locked/sharded ns/op, put-heavy locked/sharded ns/op\n";
+    for (int threads = 1; threads <= 64; threads *= 2)
+    {
+        int ops = 400000 / threads;
+        LockedLRUK_Cache<int, int> locked_get(65536, 2), locked_put(65536, 2);
+        ShardedLRUK_Cache<int, int> sharded_get(64, 65536, 2), sharded_put(64, 65536, 2);
+        double lg = benchMixed(locked_get, threads, ops, 95, 100000);
+        double sg = benchMixed(sharded_get, threads, ops, 95, 100000);
+        double lp = benchMixed(locked_put, threads, ops, 50, 100000);
+        double sp = benchMixed(sharded_put, threads, ops, 50, 100000);
+        cout << threads << "\t" << lg << "\t" << sg << "\t" << lp << "\t" << sp << "\n";
     }
+}
 
-    void put(KEY k, VALUE v)
+#if __cplusplus >= 201703L
+// 命中率约95%的只读负载(未命中时put)，1到64个线程下ConcurrentLRUK_Cache与ShardedLRUK_Cache对比
+void benchConcurrent()
+{
+    cout << "concurrent reads (~95% hits): threads, sharded/concurrent ns/op\n";
+    for (int threads = 1; threads <= 64; threads *= 2)
     {
-        // 先找cache数据
-        typename list<CacheEntry<KEY, VALUE> >::iterator entry_it = getFromCacheList(k);
-        if (entry_it != cacheList_.end())
+        int ops = 800000 / threads;
+        ShardedLRUK_Cache<int, int> sharded(64, 32768, 2);
+        ConcurrentLRUK_Cache<int, int> concurrent(64, 32768, 2);
+        // key空间略大于两个list的总容量(65536)，预先写入后均匀读取的命中率约为95%
+        int keys = 66200;
+        for (int key = 0; key < keys; key++)
         {
-            entry_it->value_ = v;
-            return;
+            sharded.put(key, key);
+            concurrent.put(key, key);
         }
+        double s = benchMixed(sharded, threads, ops, 100, keys);
+        double c = benchMixed(concurrent, threads, ops, 100, keys);
+        cout << threads << "\t" << s << "\t" << c << "\n";
+    }
+}
+#endif
 
-        // 从历史数据中查找
-        entry_it = getFromHistoryList(k);
-        if (entry_it != historyList_.end())
+// 每批100个key：getMany/putMany与逐个get/put对比，小缓存在CPU缓存中，大缓存主要是内存访问
+void benchBatch()
+{
+    cout << "batch of 100: entries, looped/getMany ns per key, looped/putMany ns per key\n";
+    const int BATCH = 100, ROUNDS = 20000;
+    for (int entries = 1024; entries <= 1048576; entries *= 32)
+    {
+        LRUK_Cache<int, int> cache(entries, 2);
+        vector<int> keys(BATCH), values(BATCH);
+        unique_ptr<bool[]> found(new bool[BATCH]);
+        for (int i = 0; i < entries; i++)
         {
-            entry_it->value_ = v;
-            return;
+            cache.put(i, i);
+            cache.put(i, i);
+        }
+        unsigned x = 1;
+        double t[4];
+        for (int mode = 0; mode < 4; mode++)
+        {
+            steady_clock::time_point start = steady_clock::now();
+            for (int round = 0; round < ROUNDS; round++)
+            {
+                for (int i = 0; i < BATCH; i++)
+                {
+                    x = x * 1664525u + 1013904223u;
+                    keys[i] = static_cast<int>((x >> 4) % entries);
+                }
+                if (mode == 0)
+                {
+                    for (int i = 0; i < BATCH; i++)
+                        found[i] = cache.get(keys[i]) != NULL;
+                }
+                else if (mode == 1)
+                    cache.getMany(&keys[0], BATCH, &values[0], found.get());
+                else if (mode == 2)
+                {
+                    for (int i = 0; i < BATCH; i++)
+                        cache.put(keys[i], keys[i]);
+                }
+                else
+                    cache.putMany(&keys[0], &keys[0], BATCH);
+            }
+            t[mode] = nsPerOp(start, static_cast<size_t>(ROUNDS) * BATCH);
         }
+        cout << entries << "\t" << t[0] << "\t" << t[1] << "\t" << t[2] << "\t" << t[3] << "\n";
+    }
+}
 
-        //没有找到相同key的记录，作为新记录插入
-        //如果历史数据没有满，则直接插入
-        if (historyList_.size() < capacity_)
+// 每次加载耗时1ms的慢速存储：threads个线程按偏斜分布读取500个key，以及冷启动时所有线程按相同顺序读取20个热点key，
+// get未命中后自行加载再put与get_or_load对比加载次数和总耗时
+void benchLoad()
+{
+    cout << "slow store (1ms per load): workload, threads, get+put loads/ms, get_or_load loads/ms\n";
+    for (int herd = 0; herd < 2; herd++)
+    {
+        for (int threads = 8; threads <= 32; threads *= 4)
         {
-            historyList_.emplace_front(k,v);
-            historyList_.begin()->access_time_.push(steady_clock::now());
-            history_map_.emplace(k,historyList_.begin());
-            return;
+            long loads[2];
+            double ms[2];
+            for (int mode = 0; mode < 2; mode++)
+            {
+                ShardedLRUK_Cache<int, int> cache(8, 400, 2);
+                atomic<long> calls(0);
+                function<int(const int &)> store = [&calls](const int &k) {
+                    calls++;
+                    this_thread::sleep_for(milliseconds(1));
+                    return k * 10;
+                };
+                vector<thread> workers;
+                steady_clock::time_point start = steady_clock::now();
+                for (int t = 0; t < threads; t++)
+                {
+                    workers.push_back(thread([&cache, &store, t, herd, mode]() {
+                        unsigned x = t * 7919 + 1;
+                        for (int i = 0; i < (herd ? 20 : 300); i++)
+                        {
+                            x = x * 1664525u + 1013904223u;
+                            double u = (x >> 8) / 16777216.0;
+                            int k = herd ? i : static_cast<int>(u * u * u * 500);
+                            int v;
+                            if (mode == 1)
+                                v = cache.get_or_load(k, store);
+                            else
+                            {
+                                bool found;
+                                v = cache.get(k, found);
+                                if (!found)
+                                {
+                                    v = store(k);
+                                    cache.put(k, v);
+                                }
+                            }
+                            assert(v == k * 10);
+                            (void)v;
+                        }
+                    }));
+                }
+                for (size_t t = 0; t < workers.size(); t++)
+                    workers[t].join();
+                loads[mode] = calls;
+                ms[mode] = duration<double, milli>(steady_clock::now() - start).count();
+            }
+            cout << (herd ? "herd" : "skewed") << "\t" << threads << "\t" << loads[0] << "/" << ms[0]
+                 << "\t" << loads[1] << "/" << ms[1] << "\n";
         }
+    }
+}
 
-        //如果历史数据满了，则淘汰一个最老的记录
-        typename list<CacheEntry<KEY, VALUE> >::iterator vict = findVictimFromHistory();
-        history_map_.erase(vict->key_);
-        historyList_.erase(vict);
-        //插入新记录
-        historyList_.emplace_front(k,v);
-        historyList_.begin()->access_time_.push(steady_clock::now());
-        history_map_.emplace(k,historyList_.begin());
+#if defined(__cpp_impl_coroutine) && __cplusplus >= 202002L
+// benchAsync的读取协程：依次co_await async_get，命中时不挂起
+Task<void> asyncBenchReader(SingleThreadExecutor &executor, AsyncLRUK_Cache<int, string> &cache, const vector<int> &keys,
+                            int &loads, size_t &bytes)
+{
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        string v = co_await cache.async_get(keys[i], [&executor, &loads](const int &key) {
+            return asyncCheckLoad(executor, loads, key);
+        });
+        bytes += v.size();
+    }
+}
 
-        return;
+// 全部命中时async_get与同步get的每次开销对比；冷启动时clients个协程读取100个key，加载协程yield模拟I/O，
+// 统计加载次数和每个请求的平均耗时
+void benchAsync()
+{
+    const int KEYS = 1024, OPS = 1000000;
+    SingleThreadExecutor executor;
+    AsyncLRUK_Cache<int, string> cache(executor, KEYS, 2);
+    vector<int> keys(OPS);
+    unsigned x = 1;
+    for (int i = 0; i < OPS; i++)
+    {
+        x = x * 1664525u + 1013904223u;
+        keys[i] = static_cast<int>((x >> 8) % KEYS);
+    }
+    for (int i = 0; i < KEYS; i++)
+    {
+        cache.cache().put(i, to_string(i));
+        cache.cache().put(i, to_string(i));
+    }
+    int loads = 0;
+    size_t bytes = 0;
+    steady_clock::time_point start = steady_clock::now();
+    executor.spawn(asyncBenchReader(executor, cache, keys, loads, bytes));
+    executor.run();
+    double async_ns = nsPerOp(start, OPS);
+    start = steady_clock::now();
+    for (int i = 0; i < OPS; i++)
+    {
+        bool found;
+        bytes += cache.cache().get(keys[i], found).size();
     }
+    cout << "async hits: async_get/get ns per op\t" << async_ns << "\t" << nsPerOp(start, OPS) << "\t(bytes " << bytes << ")\n";
 
-    void clear()
+    cout << "async cold start: clients, loads, ns per request\n";
+    for (int clients = 100; clients <= 100000; clients *= 10)
     {
-        history_map_.clear();
-        historyList_.clear();
-        cache_map_.clear();
-        cacheList_.clear();
+        AsyncLRUK_Cache<int, string> cold(executor, KEYS, 2);
+        int cold_loads = 0, done = 0, errors = 0;
+        start = steady_clock::now();
+        for (int i = 0; i < clients; i++)
+            executor.spawn(asyncCheckClient(executor, cold, i % 100, cold_loads, done, errors));
+        executor.run();
+        cout << clients << "\t" << cold_loads << "\t" << nsPerOp(start, clients) << "\n";
     }
+}
+#endif
 
-    void print()
+// 随机写入：不设置存活时间与设置存活时间对比，后者数据持续到期并由时间轮删除，每次操作的开销不随条数增长
+void benchTTL()
+{
+    cout << "ttl: entries, put ns per op without/with ttl, entries expired\n";
+    const int OPS = 2000000;
+    for (int entries = 1024; entries <= 1048576; entries *= 32)
     {
-        string msg;
-        if (cacheList_.size() > 0)
+        double t[2];
+        size_t expired = 0;
+        for (int mode = 0; mode < 2; mode++)
         {
-            msg += "cacheList:\n";
-            int num = 0;
-            typename list<CacheEntry<KEY, VALUE> >::iterator it = cacheList_.begin();
-            for (; it != cacheList_.end(); it++)
+            LRUK_Cache<int, int> cache(entries, 1);
+            cache.setRemovalListener([&expired](const int &, int &&, RemovalCause cause) {
+                if (cause == RemovalCause::EXPIRED)
+                    expired++;
+            });
+            unsigned x = 1;
+            steady_clock::time_point start = steady_clock::now();
+            for (int i = 0; i < OPS; i++)
             {
-                msg += "[";
-                msg += to_string(num);
-                msg += "] key=";
-                msg += to_string_if_not_string(it->key_);
-                msg += ", ";
-                msg += "value=";
-                msg += to_string_if_not_string(it->value_);
-                msg += "\n";
-                num++;
+                x = x * 1664525u + 1013904223u;
+                int key = static_cast<int>((x >> 4) % entries);
+                if (mode == 0)
+                    cache.put(key, i);
+                else
+                    cache.put(key, i, LogicalClock::duration(1 + (x >> 8) % entries));
             }
+            t[mode] = nsPerOp(start, OPS);
         }
-        else
-            msg += "cacheList is empty.\n";
+        cout << entries << "\t" << t[0] << "\t" << t[1] << "\t" << expired << "\n";
+    }
+}
 
-        if (historyList_.size() > 0)
+// 100万条历史记录中有1000条缓存数据，4000个热点key反复晋升并把缓存数据淘汰回historyList_，
+// 对比不设置保留时长、保留时长长于测试（不过期）和短于测试（冷数据陆续过期）时每次操作的耗时
+void benchRetention()
+{
+    const int CACHE = 1000, HISTORY = 1 << 20, HOT = 4000, OPS = 1000000;
+    cout << "retention: retained period (ticks), ns per op, demotions, expired\n";
+    const uint64_t periods[3] = {0, uint64_t(1) << 40, HISTORY / 2};
+    for (int i = 0; i < 3; i++)
+    {
+        LRUK_Cache<int, int> cache(CACHE, 2, HISTORY, LogicalClock::duration(periods[i]));
+        size_t demotions = 0, expired = 0;
+        cache.setRemovalListener([&demotions, &expired](const int &, int &&, RemovalCause cause) {
+            if (cause == RemovalCause::DEMOTED)
+                demotions++;
+            else if (cause == RemovalCause::EXPIRED)
+                expired++;
+        }, true);
+        for (int k = HOT; k < HISTORY; k++)
+            cache.put(k, k);
+        unsigned x = 1;
+        steady_clock::time_point start = steady_clock::now();
+        for (int j = 0; j < OPS; j++)
         {
-            msg += "historyList:\n";
-            int num = 0;
-            typename list<CacheEntry<KEY, VALUE> >::iterator it = historyList_.begin();
-            for (; it != historyList_.end(); it++)
+            x = x * 1664525u + 1013904223u;
+            int key = static_cast<int>((x >> 8) % HOT);
+            bool found;
+            cache.get(key, found);
+            if (!found)
+                cache.put(key, key);
+        }
+        cout << periods[i] << "\t" << nsPerOp(start, OPS) << "\t" << demotions << "\t" << expired << "\n";
+    }
+}
+
+// 缓冲池：1024个4KB页框缓存4096个页，按偏斜分布读取。调用者持有最近held个页：
+// pin直接持有句柄读取页内容，与get拷贝出整页后持有拷贝对比
+void benchPins()
+{
+    typedef vector<char> Page;
+    typedef LRUK_Cache<int, Page> Pool;
+    const int PAGE = 4096, FRAMES = 1024, PAGES = 4096, OPS = 1000000;
+    cout << "buffer pool: pages held, pin/get copy ns per op, misses, checksum of bytes read\n";
+    vector<int> trace(OPS);
+    unsigned x = 1;
+    for (int i = 0; i < OPS; i++)
+    {
+        x = x * 1664525u + 1013904223u;
+        double u = (x >> 8) / 16777216.0;
+        trace[i] = static_cast<int>(PAGES * u * u * u);
+    }
+    long sink = 0;  // 读取的字节之和，避免读取被优化掉
+    for (size_t held = 1; held <= 64; held *= 8)
+    {
+        double t[2];
+        size_t misses[2] = {0, 0};
+        for (int mode = 0; mode < 2; mode++)
+        {
+            Pool pool(FRAMES, 2, FRAMES, LogicalClock::duration());
+            vector<Pool::Pinned> handles(held);
+            vector<Page> copies(held);
+            steady_clock::time_point start = steady_clock::now();
+            for (int i = 0; i < OPS; i++)
             {
-                msg += "[";
-                msg += to_string(num);
-                msg += "] key=";
-                msg += to_string_if_not_string(it->key_);
-                msg += ", ";
-                msg += "value=";
-                msg += to_string_if_not_string(it->value_);
-                msg += "\n";
-                num++;
+                int k = trace[i];
+                if (mode == 0)
+                {
+                    Pool::Pinned h = pool.pin(k);
+                    if (!h)
+                    {
+                        misses[mode]++;
+                        pool.put(k, Page(PAGE, static_cast<char>(k)));
+                        h = pool.pin(k);
+                    }
+                    if (h)
+                        sink += (*h)[i & (PAGE - 1)];
+                    handles[i % held] = std::move(h);
+                }
+                else
+                {
+                    bool found;
+                    Page page = pool.get(k, found);
+                    if (!found)
+                    {
+                        misses[mode]++;
+                        page = Page(PAGE, static_cast<char>(k));
+                        pool.put(k, page);
+                    }
+                    sink += page[i & (PAGE - 1)];
+                    copies[i % held] = std::move(page);
+                }
             }
+            t[mode] = nsPerOp(start, OPS);
         }
-        else
-            msg += "historyList is empty.\n";
-
-        cout<<msg;
+        cout << held << "\t" << t[0] << "\t" << t[1] << "\t" << misses[0] << "/" << misses[1] << "\t" << sink << "\n";
     }
-};
+}
+
+void runBenchmarks()
+{
+    benchHitLatency();
+    benchPromotion();
+    benchGhostMemory();
+    benchPutNew();
+    benchCompileTimeK();
+    benchClock();
+    benchGetPointer();
+    benchLookup();
+    benchHashes();
+    benchSteadyAllocs();
+    benchChurn();
+    benchSharded();
+#if __cplusplus >= 201703L
+    benchConcurrent();
+#endif
+    benchBatch();
+    benchLoad();
+#if defined(__cpp_impl_coroutine) && __cplusplus >= 202002L
+    benchAsync();
+#endif
+    benchTTL();
+    benchPins();
+    benchRetention();
+}
 
-int main()
+int main(int argc, char *argv[])
 {
+    if (argc > 1 && string(argv[1]) == "bench")
+    {
+        runBenchmarks();
+        return 0;
+    }
     LRUK_Cache<int,string> cache(3,2);
     bool found = false;
     string val;
@@ -338,5 +5510,7 @@ int main()
     //historylist: [0]key=4 value="D" [1]key=3 value="C1" [2]key=2 value="B"
     cache.print();
     cache.clear();
+    //各模块的自检，失败时由assert中止
+    runSelfChecks();
     return 0;
 }
\ No newline at end of file